@@ -1,8 +1,13 @@
 struct buf;
 struct context;
+struct epoll_event;
+struct eventpoll;
 struct file;
 struct inode;
+struct iovec;
+struct mmsghdr;
 struct pipe;
+struct pollfd;
 struct proc;
 struct spinlock;
 struct sleeplock;
@@ -22,6 +27,17 @@ void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
 
+// eventpoll.c
+void            epollinit(void);
+struct eventpoll* epollalloc(void);
+void            epollclose(struct eventpoll*);
+int             epollctl(struct eventpoll*, int, int, struct file*, struct epoll_event*);
+int             epollwait(struct eventpoll*, uint64, int, int);
+void            epollnotify(struct file*);
+void            epollforget(struct file*);
+int             epollpoll(struct eventpoll*);
+void            epolltick(void);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -33,6 +49,12 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
+int             filepoll(struct pollfd*, int, int);
+int             fileready(struct file*);
+void            pollwakeup(void);
+void            polltick(void);
 
 // fs.c
 void            fsinit(int);
@@ -40,6 +62,7 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct buf*     ipinblock(struct inode*, uint);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -73,6 +96,7 @@ void            end_op(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
+int             pipepoll(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
 int             pipewrite(struct pipe*, uint64, int);
 
@@ -90,6 +114,7 @@ int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             kthread(void (*)(void*), void*, char*);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -208,24 +233,47 @@ int lst_empty(struct list*);
 // extra files for lab net
 
 // net.c
+extern int      netpoll;
+extern struct spinlock net_lock;
 void            netinit(void);
-int             nettimer(void);
+void            nettick(void);
+void            netloop(void);
+void            netintr(void);
+void            netsent(void *);
 
 // virtio_net.c
-void            virtio_net_init(void *);
-int             virtio_net_send(const void *data, int len);
-int             virtio_net_recv(void *data, int len);
+struct virtio_net_hdr;
+struct virtio_net_rxbatch;
+uint64          virtio_net_init(void *, int *);
+int             virtio_net_sendv(int qid, struct virtio_net_hdr *hdr, void **data, int *len, int n, void *cookie);
+int             virtio_net_recv(int qid, struct virtio_net_rxbatch *b, int budget);
+int             virtio_net_recv_intr(int qid, int on);
+int             virtio_net_recv_low(int qid);
+void            virtio_net_recv_done(int *slot, int n);
+void            virtio_net_reclaim(void);
+void            virtio_net_intr(void);
 
 // socket.c
-void            socket_init();
-int             socket();
+int             socket(int type);
 int             socket_connect(struct file* f, uint32 ip, uint16 prot);
 int             socket_bind(struct file* f, uint32 ip, uint16 port);
-int             socket_listen(struct file* f);
+int             socket_listen(struct file* f, int backlog);
 int             socket_accept(struct file* f);
 int             socket_read(struct file *f, uint64 buf, int n); 
 int             socket_write(struct file *f, uint64 buf, int n);
+int             socket_readv(struct file *f, struct iovec *iov, int cnt);
+int             socket_writev(struct file *f, struct iovec *iov, int cnt);
+int             socket_sendfile(struct file *f, struct inode *ip, uint off, int n);
 int             socket_close(struct file *f);
+int             socket_poll(struct file *f);
+int             socket_setcc(struct file *f, char *name);
+int             socket_sendmmsg(struct file *f, struct mmsghdr *msg, int n);
+int             socket_recvmmsg(struct file *f, struct mmsghdr *msg, int n);
+int             dgram_socket(void);
+int             dgram_close(struct file *f);
+int             dgram_bind(struct file *f, uint32 ip, uint16 port);
+int             dgram_connect(struct file *f, uint32 ip, uint16 port);
+int             dgram_poll(struct file *f);
 
 // dns_api.c
 int             dns_api_gethostbyname(const char *hostname, uint32 *addr);
@@ -10,18 +10,46 @@
 #include "stat.h"
 #include "proc.h"
 
+// a lookup in progress. the callback fills it in and wakes
+// the process sleeping on it.
+struct dns_query {
+    int done;
+    int found;
+    ip_addr_t addr;
+};
+
+// Called by lwIP, with net_lock held, once the lookup is over.
+// ipaddr is NULL if the name could not be resolved.
 void dns_found_callback_fn(const char *name, const ip_addr_t *ipaddr, void *callback_arg) {
-    //printf("dns_found_callback_fn do nothing.\n");
+    struct dns_query *q = callback_arg;
+
+    if (ipaddr) {
+        q->addr = *ipaddr;
+        q->found = 1;
+    }
+    q->done = 1;
+    wakeup(q);
 }
 
 int dns_api_gethostbyname(const char *hostname, uint32 *addr) {
     dns_found_callback dns_found_cb = dns_found_callback_fn;
+    struct dns_query q;
 
     uint32 tmp_addr = 0;
     int res;
-    do {
-        res = dns_gethostbyname(hostname, (ip_addr_t *)&tmp_addr, dns_found_cb, NULL);
-    } while (res != ERR_OK && *addr == 0);
+
+    memset(&q, 0, sizeof(q));
+    acquire(&net_lock);
+    res = dns_gethostbyname(hostname, (ip_addr_t *)&tmp_addr, dns_found_cb, &q);
+    if (res == ERR_INPROGRESS) {
+        // the network thread finishes the lookup; sleeping
+        // releases net_lock so that it can.
+        while (!q.done)
+            sleep(&q, &net_lock);
+        res = q.found ? ERR_OK : ERR_VAL;
+        tmp_addr = ip_addr_get_ip4_u32(&q.addr);
+    }
+    release(&net_lock);
 
     if (res != ERR_OK) {
         printf("dns_api_gethostbyname: cannot get the ip, error num: %d\n", res);
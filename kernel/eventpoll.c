@@ -0,0 +1,365 @@
+//
+// epoll-style event queues. A process registers the files it
+// cares about with an event queue once; the files' event sources
+// (the lwIP callbacks in socket.c) then put the registrations on
+// the queue's ready list, so that epoll_wait() only looks at files
+// that may have something to report rather than scanning them all.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "poll.h"
+
+#define NEPOLL   16   // event queues in the system
+#define NEPITEM  64   // registrations per event queue
+
+// the registration of file f with an event queue.
+struct epitem {
+  struct eventpoll *ep;
+  struct file *f;         // 0 if the slot is free
+  int fd;                 // f's fd when it was added
+  uint gen;               // bumped whenever the slot is reused
+  uint events;            // poll events asked for, and EPOLLET
+  uint64 data;            // handed back by epollwait()
+  int ready;              // on ep's ready list
+  struct epitem *rnext;   // ep's ready list
+  struct epitem *fnext;   // f->epitems, all registrations of f
+};
+
+struct eventpoll {
+  int used;
+  int ntimed;             // epollwait() callers with a timeout
+  struct epitem item[NEPITEM];
+  struct epitem *rhead;   // ready list, oldest first
+  struct epitem *rtail;
+};
+
+// protects all event queues, their ready lists and every file's
+// epitems list. taken inside net_lock by the lwIP callbacks, so
+// never call into lwIP (or fileready()) while holding it.
+struct spinlock ep_lock;
+struct eventpoll eptable[NEPOLL];
+int ep_ntimed;
+
+void
+epollinit(void)
+{
+  initlock(&ep_lock, "epoll");
+}
+
+// Put it on its queue's ready list, if not already there.
+// Caller holds ep_lock.
+static void
+epready(struct epitem *it)
+{
+  struct eventpoll *ep = it->ep;
+
+  if(it->ready)
+    return;
+  it->ready = 1;
+  it->rnext = 0;
+  if(ep->rtail)
+    ep->rtail->rnext = it;
+  else
+    ep->rhead = it;
+  ep->rtail = it;
+  wakeup(ep);
+  // ep itself may be watched by poll().
+  pollwakeup();
+}
+
+// Take it off its queue's ready list. Caller holds ep_lock.
+static void
+epunready(struct epitem *it)
+{
+  struct eventpoll *ep = it->ep;
+  struct epitem **pp, *prev = 0;
+
+  if(!it->ready)
+    return;
+  for(pp = &ep->rhead; *pp; prev = *pp, pp = &(*pp)->rnext){
+    if(*pp == it){
+      *pp = it->rnext;
+      if(ep->rtail == it)
+        ep->rtail = prev;
+      break;
+    }
+  }
+  it->ready = 0;
+  it->rnext = 0;
+}
+
+// Unlink it from its file and free the slot. Caller holds ep_lock.
+static void
+epremove(struct epitem *it)
+{
+  struct epitem **pp;
+
+  epunready(it);
+  for(pp = &it->f->epitems; *pp; pp = &(*pp)->fnext){
+    if(*pp == it){
+      *pp = it->fnext;
+      break;
+    }
+  }
+  it->f = 0;
+  it->fnext = 0;
+  it->gen++;
+}
+
+// Allocate an empty event queue. Return 0 if none are left.
+struct eventpoll*
+epollalloc(void)
+{
+  struct eventpoll *ep;
+
+  acquire(&ep_lock);
+  for(ep = eptable; ep < eptable + NEPOLL; ep++){
+    if(!ep->used){
+      ep->used = 1;
+      ep->ntimed = 0;
+      ep->rhead = ep->rtail = 0;
+      for(int i = 0; i < NEPITEM; i++){
+        ep->item[i].ep = ep;
+        ep->item[i].f = 0;
+        ep->item[i].ready = 0;
+      }
+      release(&ep_lock);
+      return ep;
+    }
+  }
+  release(&ep_lock);
+  return 0;
+}
+
+// The last reference to event queue ep is gone.
+void
+epollclose(struct eventpoll *ep)
+{
+  acquire(&ep_lock);
+  for(int i = 0; i < NEPITEM; i++)
+    if(ep->item[i].f)
+      epremove(&ep->item[i]);
+  ep->used = 0;
+  release(&ep_lock);
+}
+
+// Add, modify or remove (op) the registration of file f, open
+// as fd, with event queue ep. Only sockets can be watched.
+// Return -1 on error.
+int
+epollctl(struct eventpoll *ep, int op, int fd, struct file *f, struct epoll_event *ev)
+{
+  struct epitem *it, *free = 0;
+  int i, r = -1;
+
+  if(f->type != FD_SOCKET && f->type != FD_DGRAM)
+    return -1;
+
+  acquire(&ep_lock);
+  for(it = f->epitems; it; it = it->fnext)
+    if(it->ep == ep)
+      break;
+
+  switch(op){
+  case EPOLL_CTL_ADD:
+    if(it)
+      break;
+    for(i = 0; i < NEPITEM; i++){
+      if(ep->item[i].f == 0){
+        free = &ep->item[i];
+        break;
+      }
+    }
+    if(free == 0)
+      break;
+    free->f = f;
+    free->fd = fd;
+    free->events = ev->events;
+    free->data = ev->data;
+    free->fnext = f->epitems;
+    f->epitems = free;
+    // let epollwait() look at its state once.
+    epready(free);
+    r = 0;
+    break;
+  case EPOLL_CTL_MOD:
+    if(it == 0)
+      break;
+    it->events = ev->events;
+    it->data = ev->data;
+    epready(it);
+    r = 0;
+    break;
+  case EPOLL_CTL_DEL:
+    if(it == 0)
+      break;
+    epremove(it);
+    r = 0;
+    break;
+  }
+  release(&ep_lock);
+  return r;
+}
+
+// File f may have changed state: put its registrations on their
+// queues' ready lists and wake up those waiting on the queues.
+void
+epollnotify(struct file *f)
+{
+  struct epitem *it;
+
+  if(f->epitems == 0)
+    return;
+  acquire(&ep_lock);
+  for(it = f->epitems; it; it = it->fnext)
+    epready(it);
+  release(&ep_lock);
+}
+
+// File f is going away; drop all its registrations.
+void
+epollforget(struct file *f)
+{
+  acquire(&ep_lock);
+  while(f->epitems)
+    epremove(f->epitems);
+  release(&ep_lock);
+}
+
+// Poll events of event queue ep itself: readable while its ready
+// list is not empty.
+int
+epollpoll(struct eventpoll *ep)
+{
+  int r;
+
+  acquire(&ep_lock);
+  r = ep->rhead ? POLLIN : 0;
+  release(&ep_lock);
+  return r;
+}
+
+// Called on every clock tick, so that epollwait() can time out.
+void
+epolltick(void)
+{
+  if(ep_ntimed == 0)
+    return;
+  acquire(&ep_lock);
+  for(struct eventpoll *ep = eptable; ep < eptable + NEPOLL; ep++)
+    if(ep->used && ep->ntimed)
+      wakeup(ep);
+  release(&ep_lock);
+}
+
+// Go once through ep's ready list and copy out an epoll_event
+// for each registration whose file is ready, up to max of them,
+// to user address addr. A level-triggered registration that is
+// still ready goes back on the list. Return the number copied
+// out, or -1.
+static int
+epcollect(struct eventpoll *ep, uint64 addr, int max)
+{
+  struct proc *p = myproc();
+  struct epoll_event ev;
+  struct epitem *it;
+  struct file *f;
+  int n = 0, todo;
+  uint gen, events;
+
+  acquire(&ep_lock);
+  todo = 0;
+  for(it = ep->rhead; it; it = it->rnext)
+    todo++;
+  while(n < max && todo-- > 0 && (it = ep->rhead) != 0){
+    epunready(it);
+    // hold on to f while looking at it without ep_lock.
+    f = filedup(it->f);
+    gen = it->gen;
+    release(&ep_lock);
+
+    events = fileready(f);
+
+    acquire(&ep_lock);
+    // still registered, and not changed meanwhile?
+    if(it->f == f && it->gen == gen){
+      events &= it->events | POLLERR | POLLHUP;
+      if(events){
+        ev.events = events;
+        ev.data = it->data;
+        if(!(it->events & EPOLLET))
+          epready(it);
+      }
+    } else {
+      events = 0;
+    }
+    release(&ep_lock);
+    fileclose(f);
+    if(events){
+      if(copyout(p->pagetable, addr + n * sizeof(ev), (char*)&ev, sizeof(ev)) < 0)
+        return -1;
+      n++;
+    }
+    acquire(&ep_lock);
+  }
+  release(&ep_lock);
+  return n;
+}
+
+// Wait until some file registered with ep is ready, or timeout
+// ticks pass (no time if 0, forever if negative), and copy out
+// up to max epoll_events to user address addr.
+// Return the number copied out, or -1.
+int
+epollwait(struct eventpoll *ep, uint64 addr, int max, int timeout)
+{
+  struct proc *p = myproc();
+  uint start;
+  int n;
+
+  if(max <= 0)
+    return -1;
+
+  acquire(&tickslock);
+  start = ticks;
+  release(&tickslock);
+
+  if(timeout > 0){
+    acquire(&ep_lock);
+    ep->ntimed++;
+    ep_ntimed++;
+    release(&ep_lock);
+  }
+
+  for(;;){
+    if((n = epcollect(ep, addr, max)) != 0 || timeout == 0)
+      break;
+    if(timeout > 0 && ticks - start >= timeout)
+      break;
+
+    acquire(&ep_lock);
+    if(ep->rhead == 0 && !p->killed)
+      sleep(ep, &ep_lock);
+    release(&ep_lock);
+    if(p->killed){
+      n = -1;
+      break;
+    }
+  }
+
+  if(timeout > 0){
+    acquire(&ep_lock);
+    ep->ntimed--;
+    ep_ntimed--;
+    release(&ep_lock);
+  }
+  return n;
+}
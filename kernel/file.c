@@ -12,6 +12,9 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "poll.h"
+#include "uio.h"
+#include "socket.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -19,10 +22,21 @@ struct {
   struct file file[NFILE];
 } ftable;
 
+// processes in filepoll() sleep on pollwait until pollwakeup()
+// says some file may have become ready. seq tells that apart
+// from other wakeups.
+struct {
+  struct spinlock lock;
+  uint seq;
+  int npoll;    // processes in filepoll()
+  int ntimed;   // those of them with a timeout
+} pollwait;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  initlock(&pollwait.lock, "pollwait");
 }
 
 // Allocate a file structure.
@@ -35,6 +49,8 @@ filealloc(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
+      f->nonblock = 0;
+      f->epitems = 0;
       release(&ftable.lock);
       return f;
     }
@@ -64,6 +80,20 @@ fileclose(struct file *f)
   acquire(&ftable.lock);
   if(f->ref < 1)
     panic("fileclose");
+  if(f->ref == 1 && f->epitems){
+    // event queues dup f while looking at it; drop f from them
+    // first, then see whether one of them is now the last holder.
+    release(&ftable.lock);
+    epollforget(f);
+    acquire(&ftable.lock);
+  }
+  if(f->ref == 1 && (f->type == FD_SOCKET || f->type == FD_DGRAM)){
+    // lwIP's callbacks refer to f itself, so shut the socket
+    // down before f can be reused. no one else holds f to dup it.
+    release(&ftable.lock);
+    socket_close(f);
+    acquire(&ftable.lock);
+  }
   if(--f->ref > 0){
     release(&ftable.lock);
     return;
@@ -79,9 +109,114 @@ fileclose(struct file *f)
     begin_op();
     iput(ff.ip);
     end_op();
-  } else if(ff.type == FD_SOCKET){
-    socket_close(&ff);
+  } else if(ff.type == FD_EPOLL){
+    epollclose(ff.ep);
+  }
+}
+
+// Some file may have become ready for reading or writing.
+// Wake up the processes in filepoll(), if any.
+void
+pollwakeup(void)
+{
+  if(pollwait.npoll == 0)
+    return;
+  acquire(&pollwait.lock);
+  pollwait.seq++;
+  wakeup(&pollwait);
+  release(&pollwait.lock);
+}
+
+// Called on every clock tick, so that filepoll() can time out.
+void
+polltick(void)
+{
+  if(pollwait.ntimed)
+    pollwakeup();
+  epolltick();
+}
+
+// Which poll events apply to file f now.
+// Inodes and devices are always ready; event queues never are.
+int
+fileready(struct file *f)
+{
+  int r = 0;
+
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable);
+  if(f->type == FD_SOCKET || f->type == FD_DGRAM)
+    return socket_poll(f);
+  if(f->type == FD_EPOLL)
+    return epollpoll(f->ep);
+  if(f->readable)
+    r |= POLLIN;
+  if(f->writable)
+    r |= POLLOUT;
+  return r;
+}
+
+// Wait until at least one of the n files in pfd[] is ready for
+// the events asked for, or timeout ticks pass (no time if 0,
+// forever if negative). Fill in each revents.
+// Return the number of ready files, or -1 if killed.
+int
+filepoll(struct pollfd *pfd, int n, int timeout)
+{
+  struct proc *p = myproc();
+  struct file *f;
+  uint start, seq;
+  int i, nready;
+
+  acquire(&pollwait.lock);
+  pollwait.npoll++;
+  if(timeout > 0)
+    pollwait.ntimed++;
+  release(&pollwait.lock);
+
+  acquire(&tickslock);
+  start = ticks;
+  release(&tickslock);
+
+  for(;;){
+    // a file that becomes ready after the scan bumps seq.
+    acquire(&pollwait.lock);
+    seq = pollwait.seq;
+    release(&pollwait.lock);
+
+    nready = 0;
+    for(i = 0; i < n; i++){
+      pfd[i].revents = 0;
+      if(pfd[i].fd < 0)
+        continue;
+      if(pfd[i].fd >= NOFILE || (f = p->ofile[pfd[i].fd]) == 0)
+        pfd[i].revents = POLLNVAL;
+      else
+        pfd[i].revents = fileready(f) & (pfd[i].events | POLLERR | POLLHUP);
+      if(pfd[i].revents)
+        nready++;
+    }
+    if(nready > 0 || timeout == 0)
+      break;
+    if(timeout > 0 && ticks - start >= timeout)
+      break;
+
+    acquire(&pollwait.lock);
+    while(pollwait.seq == seq && !p->killed)
+      sleep(&pollwait, &pollwait.lock);
+    release(&pollwait.lock);
+    if(p->killed){
+      nready = -1;
+      break;
+    }
   }
+
+  acquire(&pollwait.lock);
+  pollwait.npoll--;
+  if(timeout > 0)
+    pollwait.ntimed--;
+  release(&pollwait.lock);
+  return nready;
 }
 
 // Get metadata about file f.
@@ -129,6 +264,10 @@ fileread(struct file *f, uint64 addr, int n)
     iunlock(f->ip);
   } else if(f->type == FD_SOCKET){
     r = socket_read(f, addr, n);
+  } else if(f->type == FD_DGRAM){
+    // one datagram, cut to n bytes.
+    struct mmsghdr m = { (void*)addr, n, 0, 0 };
+    r = socket_recvmmsg(f, &m, 1) == 1 ? m.msg_len : -1;
   } 
   else {
     panic("fileread");
@@ -187,6 +326,10 @@ filewrite(struct file *f, uint64 addr, int n)
   } else if(f->type == FD_SOCKET){
     //printf("socket write\n");
     ret = socket_write(f, addr, n);
+  } else if(f->type == FD_DGRAM){
+    // one datagram, to the connected peer.
+    struct mmsghdr m = { (void*)addr, n, 0, 0 };
+    ret = socket_sendmmsg(f, &m, 1) == 1 ? n : -1;
   } 
   else {
     panic("filewrite");
@@ -195,3 +338,55 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// Read from file f into the cnt buffers of iov[], in order.
+// Stop at the first buffer that is not filled; for pipes and
+// devices, after the first read, which may have waited already.
+// Return the number of bytes read, or -1 if none could be.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, tot = 0;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_SOCKET)
+    return socket_readv(f, iov, cnt);
+
+  for(i = 0; i < cnt; i++){
+    if(iov[i].iov_len == 0)
+      continue;
+    r = fileread(f, (uint64)iov[i].iov_base, iov[i].iov_len);
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r < iov[i].iov_len || f->type != FD_INODE)
+      break;
+  }
+  return tot;
+}
+
+// Write the cnt buffers of iov[] to file f, in order.
+// Return the number of bytes written, or -1 if none could be.
+int
+filewritev(struct file *f, struct iovec *iov, int cnt)
+{
+  int i, r, tot = 0;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_SOCKET)
+    return socket_writev(f, iov, cnt);
+
+  for(i = 0; i < cnt; i++){
+    if(iov[i].iov_len == 0)
+      continue;
+    r = filewrite(f, (uint64)iov[i].iov_base, iov[i].iov_len);
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    tot += r;
+    if(r < iov[i].iov_len)
+      break;
+  }
+  return tot;
+}
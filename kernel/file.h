@@ -1,28 +1,37 @@
-#define BUF_SIZE 8
-
-struct recv_buf_desc
-{
-  uint64 addr;
-  int len;
-};
+// pages of receive ring per socket, a power of two. a full
+// ring closes the socket's TCP window; the ring should hold
+// lwIP's TCP_WND, or the window never opens all the way.
+#ifdef NETBULK
+#define SOCK_RBUF_PAGES 16  // TCP_WND of the bulk profile, lwipopts.h
+#else
+#define SOCK_RBUF_PAGES 1
+#endif
 
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_SOCKET } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_SOCKET, FD_DGRAM, FD_EPOLL } type;
   
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK; honored by FD_SOCKET and FD_DGRAM
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE and FD_DEVICE
   short major;       // FD_DEVICE
   short minor;       // FD_DEVICE
   struct tcp_pcb* pcb; // FD_SOCKET
+  const struct tcp_cc_ops* cc; // FD_SOCKET; congestion control, 0 for lwIP's default
+  struct udp_pcb* upcb; // FD_DGRAM
+  struct spinlock lock; // FD_SOCKET and FD_DGRAM; protects status and rbuf*
   enum { SUCCESS, FAILURE, PENDING, CON_CLOSED} status; // FD_SOCKET
-  int rbuf_size;     // FD_SOCKET
-  struct recv_buf_desc rbuf[BUF_SIZE]; // FD_SOCKET
-  int rbuf_head;     // FD_SOCKET
-  int rbuf_tail;     // FD_SOCKET
+  char *rbuf[SOCK_RBUF_PAGES]; // FD_SOCKET; receive ring. FD_DGRAM; datagram queue
+  uint rbuf_head;    // FD_SOCKET and FD_DGRAM; bytes read
+  uint rbuf_tail;    // FD_SOCKET and FD_DGRAM; bytes received
+  struct file *aq_next; // FD_SOCKET; next on the listener's accept queue
+  struct file *aq_head; // FD_SOCKET listener; accept queue, oldest first
+  struct file *aq_tail; // FD_SOCKET listener
+  struct eventpoll *ep; // FD_EPOLL
+  struct epitem *epitems; // event queues watching this file
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
@@ -476,6 +476,23 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Return the buffer holding the block of ip's data with byte off
+// in it, pinned in the cache but not locked, so that it can be
+// lent out (see socket_sendfile()); the caller bunpin()s it.
+// Caller must hold ip->lock, and off must be below ip->size.
+struct buf*
+ipinblock(struct inode *ip, uint off)
+{
+  struct buf *bp;
+
+  if(off >= ip->size)
+    panic("ipinblock");
+  bp = bread(ip->dev, bmap(ip, off/BSIZE));
+  bpin(bp);
+  brelse(bp);
+  return bp;
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -21,3 +21,6 @@
 void printf(char *, ...);
 void panic(char *) __attribute__((noreturn));
 unsigned long r_mtime(void);
+
+/* level returned by sys_arch_protect(), see kernel/net.c */
+typedef int sys_prot_t;
@@ -1,6 +1,7 @@
 #define NO_SYS 1
 
-#define SYS_LIGHTWEIGHT_PROT 0
+/* pbufs are freed from the NIC interrupt too; see sys_arch_protect() */
+#define SYS_LIGHTWEIGHT_PROT 1
 
 #define LWIP_NETCONN 0
 #define LWIP_SOCKET 0
@@ -12,11 +13,63 @@
 
 #define LWIP_NETIF_LOOPBACK 1
 
+/* DHCP and DNS take two; the rest are for datagram sockets */
+#define MEMP_NUM_UDP_PCB 8
+/* listen(2) backlogs; see socket_listen() */
+#define TCP_LISTEN_BACKLOG 1
+
 #define LWIP_DEBUG 1
 // #define TCP_DEBUG LWIP_DBG_ON
 // #define DHCP_DEBUG LWIP_DBG_ON
 // //#define NETIF_DEBUG LWIP_DBG_ON
 // //#define ETHARP_DEBUG LWIP_DBG_ON
 
+/* the NIC may take over TCP/UDP checksums, see linkinit() */
+#define LWIP_CHECKSUM_CTRL_PER_NETIF 1
+
+/* rx buffers of the NIC are handed to lwIP as custom pbufs */
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+
+/* the NIC may segment TCP for us; see linkinit() */
+#define LWIP_TCP_TSO 1
+
+/* find the pcb of an incoming segment by hashing, not list walks */
+#define TCP_PCB_HASH_SIZE 256
+
+/* timer wheels, so that timers cost what expires rather than what is
+   pending: 4s of 16ms slots for sys_timeout(), 2*MSL of slow ticks
+   (240) for TIME-WAIT pcbs, and as many for the timers of active pcbs */
+#define LWIP_TIMERS_WHEEL_SIZE 256
+#define TCP_TW_WHEEL_SIZE 256
+#define TCP_ACTIVE_WHEEL_SIZE 256
+
 #define MEM_USE_POOLS 1
 #define MEMP_USE_CUSTOM_POOLS 1
+
+/*
+ * TCP profile. The default keeps lwIP's small footprint: an MSS of
+ * 536 and a window of 4 MSS, a few KB in flight per connection.
+ * "make NETBULK=1" builds for bulk transfers instead: full-size
+ * segments for netif->mtu 1500, a 64KB scaled window with SACK, and
+ * pools sized to keep both windows of several connections full.
+ * SOCK_RBUF_PAGES (file.h) and lwippools.h follow the same switch.
+ */
+#ifdef NETBULK
+#define TCP_MSS 1460
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE 1
+#define TCP_WND (64 * 1024)
+#define TCP_SND_BUF (64 * 1024)
+/* segments queued per connection: a full send buffer of
+   half-full segments, as lwIP's default does */
+#define TCP_SND_QUEUELEN ((4 * TCP_SND_BUF + TCP_MSS - 1) / TCP_MSS)
+/* lwIP only sends SACK options; it does not act on the peer's */
+#define LWIP_TCP_SACK_OUT 1
+/* keep out-of-order data for about one window per connection */
+#define TCP_OOSEQ_MAX_BYTES TCP_WND
+#define MEMP_NUM_TCP_PCB 16
+#define MEMP_NUM_TCP_SEG (4 * TCP_SND_QUEUELEN)
+/* PBUF_REF/ROM, e.g. the blocks lent by sendfile() */
+#define MEMP_NUM_PBUF TCP_SND_QUEUELEN
+#define PBUF_POOL_SIZE 64
+#endif
@@ -1,3 +1,10 @@
 LWIP_MALLOC_MEMPOOL_START
+#ifdef NETBULK
+/* a copied segment of TCP_MSS bytes takes a 2048 block; headers of
+   segments that reference their data take a 256 one */
+LWIP_MALLOC_MEMPOOL(256, 256)
+LWIP_MALLOC_MEMPOOL(256, 2048)
+#else
 LWIP_MALLOC_MEMPOOL(4, 2048)
+#endif
 LWIP_MALLOC_MEMPOOL_END
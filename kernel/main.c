@@ -31,10 +31,10 @@ main()
     binit();         // buffer cache
     iinit();         // inode cache
     fileinit();      // file table
+    epollinit();     // epoll event queues
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     netinit();       // init IwIP
-    socket_init();   // init socket lock
     __sync_synchronize();
     started = 1;
   } else {
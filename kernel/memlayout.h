@@ -8,6 +8,7 @@
 // 0C000000 -- PLIC
 // 10000000 -- uart0 
 // 10001000 -- virtio disk 
+// 10002000 -- virtio net
 // 80000000 -- boot ROM jumps here in machine mode
 //             -kernel loads the kernel here
 // unused RAM after 80000000.
@@ -25,6 +26,7 @@
 #define VIRTIO0 0x10001000 // disk
 #define VIRTIO1 0x10002000 // net
 #define VIRTIO0_IRQ 1
+#define VIRTIO1_IRQ 2
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
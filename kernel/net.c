@@ -4,57 +4,417 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "virtio.h"
 #include "lwip/dhcp.h"
 #include "lwip/etharp.h"
+#include "lwip/inet_chksum.h"
 #include "lwip/init.h"
+#include "lwip/memp.h"
 #include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/prot/ethernet.h"
+#include "lwip/prot/ip.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/stats.h"
+#include "lwip/sys.h"
 #include "lwip/timeouts.h"
 
 struct netif netif;
 
+// nonzero to have the network thread poll the NIC instead of
+// sleeping until VIRTIO1_IRQ. kept as a fallback.
+int netpoll = 0;
+
+// nonzero to pass received frames to lwIP in the NIC's own
+// buffers rather than copying them into a PBUF_RAM pbuf.
+int netzerocopy = 1;
+
+// frames up to this size are copied anyway; that is cheaper
+// than keeping a whole ring buffer away from the device.
+#define RX_COPYBREAK 128
+
+// a pbuf pointing into an rx ring buffer of virtio_net.c.
+// freeing it gives the buffer back to the device.
+struct rxpbuf {
+  struct pbuf_custom pc;
+  int slot;
+};
+
+// bounds how many ring buffers lwIP may hold at once.
+LWIP_MEMPOOL_DECLARE(RX_PBUF, 128, sizeof(struct rxpbuf), "rx pbuf");
+
+// most ring buffers one received packet may span: a 64KB
+// TCP aggregate from the device, in 1514-byte buffers.
+#define MAXRXBUF 48
+
+// most packets taken off the NIC per poll, so that a flood
+// of them cannot keep a hart in the interrupt handler.
+#define RX_BUDGET 16
+
+// nonzero while rx interrupts are off because packets came in
+// faster than one budget per poll. the network thread polls the
+// NIC meanwhile, as with netpoll. see netrx().
+static int netbusy;
+
+// queue pairs the NIC spreads traffic over, one per hart at
+// most. see virtio_net_init(). this only spreads flows on the
+// device side: every queue is drained under net_lock, so lwIP
+// still handles one packet at a time.
+static int nqueues = 1;
+
+// the core lwIP lock. lwIP is not thread safe; whoever calls
+// into it holds net_lock: the network thread while it runs lwIP,
+// the socket layer, and the boot-time DHCP loop.
+struct spinlock net_lock;
+
+// the network thread sleeps on netkick until the NIC interrupts
+// or an lwIP timer is due. see netd().
+static struct spinlock netd_lock;
+static int netkick;
+
+// sys_now() when lwIP's next timer is due, set by netd().
+static volatile uint32 netdeadline;
+
+// SYS_ARCH_PROTECT for lwIP's pbuf and memp bookkeeping, which
+// is reached from the NIC interrupt on any hart as well as from
+// lwIP proper. see sys_arch_protect().
+static struct spinlock lwprot_lock;
+static int lwprot_depth;
+
+// checksums the NIC computes on send (csum_tx) and validates
+// on receive (csum_rx), as negotiated in linkinit().
+static int csum_tx, csum_rx;
+
+// lwIP's checksum work on netif, minus what the NIC does on send.
+static u16_t chksum_flags;
+
+// most pieces linkoutput() hands to the NIC for one frame.
+// longer pbuf chains are copied first. lwIP builds TSO frames
+// of no more than this many pbufs (netif->tso_max_pbufs).
+#define MAXSEG 64
+
+// lwIP left the TCP/UDP checksum of outgoing frame p at zero.
+// Ask the device to compute it, seeding the checksum field with
+// the pseudo header sum as the virtio spec requires. If mss is
+// not 0, p is a TCP segment lwIP wants cut into mss-sized ones.
+// Return -1 if the headers are not all in the first pbuf.
+static int
+tx_csum(struct pbuf *p, struct virtio_net_hdr *hdr, int mss)
+{
+  struct eth_hdr *ethhdr = p->payload;
+  struct ip_hdr *iphdr;
+  u16_t *sum, *addr;
+  u32_t acc;
+  int iphlen, off;
+
+  if(p->len < SIZEOF_ETH_HDR + IP_HLEN || ethhdr->type != PP_HTONS(ETHTYPE_IP))
+    return 0;
+  iphdr = (struct ip_hdr*)((u8_t*)p->payload + SIZEOF_ETH_HDR);
+  iphlen = IPH_HL_BYTES(iphdr);
+
+  // a fragmented UDP datagram went out with checksum 0 (none).
+  if(IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK | IP_MF))
+    return 0;
+  if(IPH_PROTO(iphdr) == IP_PROTO_TCP)
+    off = 16;
+  else if(IPH_PROTO(iphdr) == IP_PROTO_UDP)
+    off = 6;
+  else
+    return 0;
+  if(p->len < SIZEOF_ETH_HDR + iphlen + off + 2)
+    return -1;
+
+  // ones' complement sum of src, dst, protocol and L4 length.
+  addr = (u16_t*)((u8_t*)iphdr + 12);
+  acc = addr[0] + addr[1] + addr[2] + addr[3];
+  acc += lwip_htons(IPH_PROTO(iphdr));
+  acc += lwip_htons(lwip_ntohs(IPH_LEN(iphdr)) - iphlen);
+  acc = FOLD_U32T(acc);
+  acc = FOLD_U32T(acc);
+
+  sum = (u16_t*)((u8_t*)iphdr + iphlen + off);
+  *sum = (u16_t)acc;
+
+  hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+  hdr->csum_start = SIZEOF_ETH_HDR + iphlen;
+  hdr->csum_offset = off;
+
+  if(mss && IPH_PROTO(iphdr) == IP_PROTO_TCP){
+    struct tcp_hdr *tcphdr = (struct tcp_hdr*)((u8_t*)iphdr + iphlen);
+    if(p->len < SIZEOF_ETH_HDR + iphlen + TCPH_HDRLEN_BYTES(tcphdr))
+      return -1;
+    hdr->gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+    hdr->gso_size = mss;
+    hdr->hdr_len = SIZEOF_ETH_HDR + iphlen + TCPH_HDRLEN_BYTES(tcphdr);
+  }
+  return 0;
+}
+
+// Pick the tx queue for frame p by hashing its IPv4 addresses and
+// TCP/UDP ports, so that each flow stays on one queue and its
+// frames go out in order. Anything else goes on queue 0.
+static int
+tx_queue(struct pbuf *p)
+{
+  struct eth_hdr *ethhdr = p->payload;
+  struct ip_hdr *iphdr;
+  u16_t *ports;
+  u32_t h;
+  int iphlen;
+
+  if(nqueues == 1)
+    return 0;
+  if(p->len < SIZEOF_ETH_HDR + IP_HLEN || ethhdr->type != PP_HTONS(ETHTYPE_IP))
+    return 0;
+  iphdr = (struct ip_hdr*)((u8_t*)p->payload + SIZEOF_ETH_HDR);
+  iphlen = IPH_HL_BYTES(iphdr);
+  h = iphdr->src.addr ^ iphdr->dest.addr;
+  if((IPH_PROTO(iphdr) == IP_PROTO_TCP || IPH_PROTO(iphdr) == IP_PROTO_UDP) &&
+     !(IPH_OFFSET(iphdr) & PP_HTONS(IP_OFFMASK)) &&
+     p->len >= SIZEOF_ETH_HDR + iphlen + 4){
+    ports = (u16_t*)((u8_t*)iphdr + iphlen);
+    h ^= ports[0] ^ ((u32_t)ports[1] << 16);
+  }
+  h ^= h >> 16;
+  h ^= h >> 8;
+  return h % nqueues;
+}
+
+// Send the frame in pbuf chain p as one virtio descriptor chain,
+// one descriptor per pbuf. The chain stays referenced until the
+// device is done with it and netsent() drops the reference.
+// TCP segments longer than the MTU go to the device in one piece
+// for it to segment (TSO). Each flow has its own tx queue.
 err_t
 linkoutput(struct netif *netif, struct pbuf *p)
 {
+  struct virtio_net_hdr hdr;
+  void *data[MAXSEG];
+  int len[MAXSEG];
+  int n = 0;
+  int mss = p->tso_mss;
   struct pbuf *q;
 
-  for (q = p; q; q = q->next) {
-    if(virtio_net_send(q->payload, q->len))
-      return ERR_IF;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.gso_type = VIRTIO_NET_HDR_GSO_NONE;
+
+  if(pbuf_clen(p) > MAXSEG || (csum_tx && tx_csum(p, &hdr, mss) < 0)){
+    // a TSO frame of up to 64KB is too big for any one block of
+    // lwIP's heap; copy it into a chain of pool pbufs instead.
+    if((p = pbuf_clone(PBUF_RAW, mss ? PBUF_POOL : PBUF_RAM, p)) == 0)
+      return ERR_MEM;
+    if(pbuf_clen(p) > MAXSEG){
+      pbuf_free(p);
+      return ERR_MEM;
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    if(csum_tx)
+      tx_csum(p, &hdr, mss);
+  } else {
+    pbuf_ref(p);
   }
 
+  for(q = p; q; q = q->next){
+    if(q->len == 0)
+      continue;
+    data[n] = q->payload;
+    len[n] = q->len;
+    n++;
+  }
+
+  if(virtio_net_sendv(tx_queue(p), &hdr, data, len, n, p) < 0){
+    pbuf_free(p);
+    return ERR_IF;
+  }
   return ERR_OK;
 }
 
-int
-linkinput(struct netif *netif)
+// The NIC has finished sending the frame linkoutput() passed
+// it as cookie.
+void
+netsent(void *cookie)
 {
-  int len;
-  struct pbuf *p;
+  pbuf_free((struct pbuf*)cookie);
+}
+
+static void
+rxpbuf_free(struct pbuf *p)
+{
+  struct rxpbuf *rp = (struct rxpbuf*)p;
+  int slot = rp->slot;
+
+  LWIP_MEMPOOL_FREE(RX_PBUF, rp);
+  virtio_net_recv_done(&slot, 1);
+}
+
+// Give received frame p to lwIP. lwIP's TCP/UDP checksum
+// checks are skipped for frames the NIC vouches for.
+static void
+deliver(struct netif *netif, struct pbuf *p, struct virtio_net_hdr *hdr)
+{
+  u16_t flags = chksum_flags;
+
+  if(csum_rx &&
+     (hdr->flags & (VIRTIO_NET_HDR_F_DATA_VALID | VIRTIO_NET_HDR_F_NEEDS_CSUM)))
+    flags &= ~(NETIF_CHECKSUM_CHECK_TCP | NETIF_CHECKSUM_CHECK_UDP);
+  NETIF_SET_CHECKSUM_CTRL(netif, flags);
+
+  if(netif->input(p, netif) != ERR_OK){
+    LINK_STATS_INC(link.drop);
+    pbuf_free(p);
+  }
+}
+
+// Hand lwIP the packets it sent to this host. Those looped back
+// on netif went out without the TCP/UDP checksums the NIC would
+// have filled in, so they are not checked on the way in either,
+// whatever deliver() last set for a packet from the NIC.
+// Caller holds net_lock.
+void
+netloop(void)
+{
+  u16_t flags = chksum_flags;
+
+  if(csum_tx)
+    flags &= ~(NETIF_CHECKSUM_CHECK_TCP | NETIF_CHECKSUM_CHECK_UDP);
+  NETIF_SET_CHECKSUM_CTRL(&netif, flags);
+  netif_poll_all();
+}
+
+// Make a pbuf chain of the n ring buffers holding a received
+// packet, which lwIP gives back to the device when it frees it.
+// Return 0 if there are not enough rxpbufs.
+static struct pbuf*
+rx_lend(void **data, int *len, int *slot, int n)
+{
+  struct rxpbuf *rp[MAXRXBUF];
+  struct pbuf *p = 0, *q;
+  int i;
 
-  p = pbuf_alloc(PBUF_RAW, 1514, PBUF_RAM);
-  if(!p)
+  if(n > MAXRXBUF)
     return 0;
+  for(i = 0; i < n; i++){
+    if((rp[i] = LWIP_MEMPOOL_ALLOC(RX_PBUF)) == 0){
+      while(--i >= 0)
+        LWIP_MEMPOOL_FREE(RX_PBUF, rp[i]);
+      return 0;
+    }
+  }
+  for(i = 0; i < n; i++){
+    rp[i]->slot = slot[i];
+    rp[i]->pc.custom_free_function = rxpbuf_free;
+    q = pbuf_alloced_custom(PBUF_RAW, len[i], PBUF_REF, &rp[i]->pc, data[i], len[i]);
+    if(p)
+      pbuf_cat(p, q);
+    else
+      p = q;
+  }
+  return p;
+}
 
-  len = virtio_net_recv(p->payload, p->len);
+// Copy the received packet in the n ring buffers into a new
+// pbuf and give the buffers back to the device.
+static struct pbuf*
+rx_copy(void **data, int *len, int *slot, int n, int tot)
+{
+  struct pbuf *p;
+  int i, off = 0;
 
-  if(len > 0){
-    /* shrink pbuf to actual size */
-    pbuf_realloc(p, len);
+  // large packets would not fit the heap in one piece.
+  p = pbuf_alloc(PBUF_RAW, tot, tot <= 1514 ? PBUF_RAM : PBUF_POOL);
+  for(i = 0; p && i < n; i++){
+    pbuf_take_at(p, data[i], len[i], off);
+    off += len[i];
+  }
+  virtio_net_recv_done(slot, n);
+  return p;
+}
 
-    if(netif->input(p, netif) == ERR_OK)
-      return len;
+// Take up to budget packets off rx queue qid of the NIC in one
+// batch and hand them to lwIP, one pbuf chain each. Returns the
+// number taken.
+int
+linkinput(struct netif *netif, int qid, int budget)
+{
+  // too big for the kernel stack; net_lock serializes callers.
+  static struct virtio_net_rxbatch b;
+  static struct pbuf *pkt[RX_BUDGET];
+  int i, j, k, n, tot;
 
-    printf("linkinput: drop packet (%d bytes)\n", len);
+  if(budget > RX_BUDGET)
+    budget = RX_BUDGET;
+  if((n = virtio_net_recv(qid, &b, budget)) == 0)
+    return 0;
+
+  // make all the pbufs first, then run lwIP over the lot.
+  for(i = k = 0; i < n; k += b.n[i], i++){
+    for(j = tot = 0; j < b.n[i]; j++)
+      tot += b.len[k+j];
+    pkt[i] = 0;
+    if(netzerocopy && tot > RX_COPYBREAK && !virtio_net_recv_low(qid))
+      pkt[i] = rx_lend(&b.data[k], &b.len[k], &b.slot[k], b.n[i]);
+    if(pkt[i] == 0 && (pkt[i] = rx_copy(&b.data[k], &b.len[k], &b.slot[k], b.n[i], tot)) == 0){
+      // dropped; counted where lwIP keeps its link statistics.
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+    }
   }
+  for(i = 0; i < n; i++)
+    if(pkt[i])
+      deliver(netif, pkt[i], &b.hdr[i]);
+  return n;
+}
 
-  pbuf_free(p);
-  return len;
+// Poll the NIC once, NAPI style: take up to RX_BUDGET packets off
+// each rx queue, starting with this hart's own. A queue that gave
+// less goes back to waiting for an interrupt; one that filled the
+// budget keeps rx interrupts off and has the network thread poll
+// (netbusy) until the load drops. Caller holds net_lock.
+static int
+netrx(void)
+{
+  int i, qid, n, tot = 0, busy = 0;
+
+  for(i = 0; i < nqueues; i++){
+    qid = (cpuid() + i) % nqueues;
+    n = linkinput(&netif, qid, RX_BUDGET);
+    tot += n;
+    if(netpoll)
+      continue;
+    if(n == RX_BUDGET){
+      virtio_net_recv_intr(qid, 0);
+      busy = 1;
+    } else if(virtio_net_recv_intr(qid, 1)){
+      // packets that came in meanwhile may not interrupt; poll once more.
+      busy = 1;
+    }
+  }
+  if(!netpoll)
+    netbusy = busy;
+  return tot;
 }
 
 err_t
 linkinit(struct netif *netif)
 {
-  virtio_net_init(&netif->hwaddr);
+  uint64 features = virtio_net_init(&netif->hwaddr, &nqueues);
+
+  // let the NIC do the TCP/UDP checksums it offered to do.
+  // IP header checksums stay with lwIP; they are cheap.
+  csum_tx = (features & (1 << VIRTIO_NET_F_CSUM)) != 0;
+  csum_rx = (features & (1 << VIRTIO_NET_F_GUEST_CSUM)) != 0;
+  chksum_flags = NETIF_CHECKSUM_ENABLE_ALL;
+  if(csum_tx)
+    chksum_flags &= ~(NETIF_CHECKSUM_GEN_TCP | NETIF_CHECKSUM_GEN_UDP);
+  NETIF_SET_CHECKSUM_CTRL(netif, chksum_flags);
+
+  // let lwIP pass down TCP segments of up to 64KB for the NIC
+  // to cut into MSS-sized frames. see linkoutput().
+  if(features & (1 << VIRTIO_NET_F_HOST_TSO4)){
+    netif->tso_max = 0xffff - SIZEOF_ETH_HDR;
+    netif->tso_max_pbufs = MAXSEG;
+  }
 
   netif->hwaddr_len = ETH_HWADDR_LEN;
   netif->linkoutput = linkoutput;
@@ -93,8 +453,10 @@ netadd(void)
   /* wait until DHCP succeeds */
   printf("waiting for DHCP success\n");
   while(!dhcp_supplied_address(&netif)){
-    linkinput(&netif);
+    acquire(&net_lock);
+    netrx();
     sys_check_timeouts();
+    release(&net_lock);
   }
 
   ipaddr_ntoa_r(netif_ip_addr4(&netif), addr, sizeof(addr));
@@ -103,19 +465,104 @@ netadd(void)
   printf("net: addr %s netmask %s gw %s\n", addr, netmask, gw);
 }
 
-int
-nettimer(void)
+// Wake the network thread.
+static void
+netwake(void)
+{
+  acquire(&netd_lock);
+  netkick = 1;
+  wakeup(&netkick);
+  release(&netd_lock);
+}
+
+// The network thread. It owns lwIP: it gives back the frames the
+// NIC has sent, hands received packets to lwIP a budget's worth
+// at a time, and runs lwIP's timers. It sleeps until the NIC
+// interrupts or a timer is due, except while the NIC is too busy
+// for interrupts (netbusy) or polled (netpoll); then it polls,
+// yielding to other processes between polls.
+static void
+netd(void *arg)
+{
+  u32_t ms;
+
+  for(;;){
+    acquire(&netd_lock);
+    while(!netkick && !netpoll && !netbusy)
+      sleep(&netkick, &netd_lock);
+    netkick = 0;
+    release(&netd_lock);
+
+    acquire(&net_lock);
+    virtio_net_reclaim();
+    netrx();
+    netloop();
+    sys_check_timeouts();
+    // look again at least once a second.
+    if((ms = sys_timeouts_sleeptime()) > 1000)
+      ms = 1000;
+    netdeadline = sys_now() + ms;
+    release(&net_lock);
+
+    if(netpoll || netbusy)
+      yield();
+  }
+}
+
+// Called on every clock tick. Wake the network thread if one
+// of lwIP's timers is due.
+void
+nettick(void)
 {
-  sys_check_timeouts();
-  return linkinput(&netif);
+  if(!netpoll && (int)(sys_now() - netdeadline) >= 0)
+    netwake();
+}
+
+// Called from virtio_net_intr(). Turn rx interrupts off until
+// the network thread has drained the NIC, and wake it.
+void
+netintr(void)
+{
+  int i;
+
+  if(!netpoll)
+    for(i = 0; i < nqueues; i++)
+      virtio_net_recv_intr(i, 0);
+  netwake();
 }
 
 void
 netinit(void)
 {
+  initlock(&lwprot_lock, "lwip prot");
+  initlock(&net_lock, "net");
+  initlock(&netd_lock, "netd");
   lwip_init();
+  LWIP_MEMPOOL_INIT(RX_PBUF);
   netadd();
   netif_set_default(&netif);
+  if(kthread(netd, 0, "netd") < 0)
+    panic("netinit: netd");
+}
+
+// lwIP may nest protected regions, so the lock is taken
+// only by the outermost one.
+sys_prot_t
+sys_arch_protect(void)
+{
+  push_off();
+  if(!holding(&lwprot_lock))
+    acquire(&lwprot_lock);
+  pop_off();
+  return lwprot_depth++;
+}
+
+void
+sys_arch_unprotect(sys_prot_t lev)
+{
+  lwprot_depth = lev;
+  if(lev == 0)
+    release(&lwprot_lock);
 }
 
 uint32
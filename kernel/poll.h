@@ -0,0 +1,26 @@
+// poll() events.
+#define POLLIN    0x001  // there is data to read
+#define POLLOUT   0x004  // writing now will not block
+#define POLLERR   0x008  // error condition (revents only)
+#define POLLHUP   0x010  // hung up (revents only)
+#define POLLNVAL  0x020  // fd is not open (revents only)
+
+struct pollfd {
+  int fd;          // ignored if negative
+  short events;    // events asked for
+  short revents;   // events that apply, filled in by poll()
+};
+
+// epoll_ctl() operations
+#define EPOLL_CTL_ADD  1
+#define EPOLL_CTL_DEL  2
+#define EPOLL_CTL_MOD  3
+
+// edge-triggered: report an fd once per change of its state,
+// rather than for as long as it is ready. or'ed into events.
+#define EPOLLET   0x8000
+
+struct epoll_event {
+  uint events;     // poll events, plus EPOLLET for epoll_ctl()
+  uint64 data;     // for the caller; handed back by epoll_wait()
+};
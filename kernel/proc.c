@@ -19,6 +19,7 @@ int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void wakeup1(struct proc *chan);
 
 extern char trampoline[]; // trampoline.S
@@ -145,6 +146,8 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->kfunc = 0;
+  p->karg = 0;
   p->state = UNUSED;
 }
 
@@ -221,6 +224,33 @@ userinit(void)
   release(&p->lock);
 }
 
+// Create a kernel thread that runs fn(arg) in the kernel, with
+// its own kernel stack, and is scheduled like any process. It
+// has no user memory and never returns to user space, so fn
+// must not return. Returns the thread's pid, or -1.
+int
+kthread(void (*fn)(void*), void *arg, char *name)
+{
+  struct proc *p;
+  int pid;
+
+  if((p = allocproc()) == 0)
+    return -1;
+
+  // start at kthreadret rather than forkret.
+  p->context.ra = (uint64)kthreadret;
+  p->kfunc = fn;
+  p->karg = arg;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  pid = p->pid;
+  p->state = RUNNABLE;
+
+  release(&p->lock);
+
+  return pid;
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -456,10 +486,6 @@ scheduler(void)
     // a race between an interrupt and WFI, which would
     // cause a lost wakeup.
     intr_off();
-    if (cpuid()==0) {
-      nettimer();
-    }
-    
 
     int found = 0;
     for(p = proc; p < &proc[NPROC]; p++) {
@@ -550,6 +576,24 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  // the scheduler runs with interrupts off; a kernel thread
+  // does not get them turned back on by usertrapret().
+  intr_on();
+
+  p->kfunc(p->karg);
+  panic("kthread returned");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -103,4 +103,8 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+
+  // kernel threads only; see kthread().
+  void (*kfunc)(void*);        // Function the thread runs
+  void *karg;                  // Its argument
 };
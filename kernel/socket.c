@@ -1,5 +1,8 @@
 #include "lwip/include/lwip/tcp.h"
+#include "lwip/include/lwip/udp.h"
+#include "lwip/include/lwip/netif.h"
 #include "lwip/include/lwip/ip_addr.h"
+#include "lwip/include/lwip/priv/tcp_priv.h"
 #include "types.h"
 #include "riscv.h"
 #include "defs.h"
@@ -7,78 +10,228 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
+#include "buf.h"
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "poll.h"
+#include "uio.h"
+#include "socket.h"
 
-struct spinlock socket_lock;
+// Locking. net_lock (see net.c) is the core lwIP lock: it must be
+// held to call into lwIP, and it is held by the network thread
+// while lwIP runs the callbacks below. Each socket's f->lock
+// protects its receive buffer and status. It is taken inside
+// net_lock, never the other way around, so sockets on different
+// harts only meet on net_lock while they are in lwIP itself.
 
 
+// bytes the receive ring of a socket holds.
+#define RBUF_SIZE (SOCK_RBUF_PAGES * PGSIZE)
+
 /*-------------------- HELPER FUNCTION ---------------------------*/
-// free a descriptor in recv buf. This function is not thread safe.
-// It must called within a critical area.
-void free_recv_buf_desc(struct file* f) {
-  if (f->rbuf_size <= 0) {
-    panic("wrongly free recv_buf_desc");
-  }
-  f->rbuf_size--;
-  int idx = f->rbuf_head % BUF_SIZE;
-  kfree((void*)f->rbuf[idx].addr);
-  f->rbuf[idx].addr = 0;
-  f->rbuf[idx].len = 0;
-  f->rbuf_head++;
-}
-
-// Try to allocate a descriptor in recv buf. 
-// If successful, it will return the index of the descriptor.
-// Otherwise, it will return -1.
-// This function is not thread safe. It must called within a critical area.
-int alloc_recv_buf_desc(struct file* f) {
-  if (f->rbuf_size >= BUF_SIZE) {
-    printf("socket recv buf is full.\n");
-    return -1;
+// free the receive ring of socket f.
+void free_recv_buf(struct file* f) {
+  for (int i = 0; i < SOCK_RBUF_PAGES; i++) {
+    if (f->rbuf[i]) kfree(f->rbuf[i]);
+    f->rbuf[i] = 0;
+  }
+}
+
+// allocate an empty receive ring for socket f.
+// Return -1 if there is not enough memory.
+int alloc_recv_buf(struct file* f) {
+  for (int i = 0; i < SOCK_RBUF_PAGES; i++) {
+    f->rbuf[i] = 0;
   }
-  int idx = f->rbuf_tail % BUF_SIZE;
-  f->rbuf[idx].addr = (uint64)kalloc();
-  f->rbuf[idx].len = PGSIZE;
-  f->rbuf_size++;
-  f->rbuf_tail++;
+  for (int i = 0; i < SOCK_RBUF_PAGES; i++) {
+    if ((f->rbuf[i] = kalloc()) == 0) {
+      free_recv_buf(f);
+      return -1;
+    }
+  }
+  f->rbuf_head = 0;
+  f->rbuf_tail = 0;
+  return 0;
+}
 
-  return idx;
+// number of unread bytes in the receive ring.
+// Caller must hold f->lock.
+int recv_buf_used(struct file* f) {
+  return f->rbuf_tail - f->rbuf_head;
 }
 
-/*-------------------- SOCKET FUNCTION ---------------------------*/
-void socket_init() { initlock(&socket_lock, "socket"); }
+// append n bytes at src to the receive ring.
+// Caller must hold f->lock and make sure it fits.
+void recv_buf_write(struct file* f, char* src, int n) {
+  while (n > 0) {
+    uint off = f->rbuf_tail % RBUF_SIZE;
+    int m = PGSIZE - off % PGSIZE;  // up to the end of the page
+    if (m > n) m = n;
+    memmove(f->rbuf[off / PGSIZE] + off % PGSIZE, src, m);
+    f->rbuf_tail += m;
+    src += m;
+    n -= m;
+  }
+}
+
+// append the data of pbuf chain p to the receive ring.
+// Caller must hold f->lock and make sure it fits.
+void recv_buf_put(struct file* f, struct pbuf* p) {
+  for (struct pbuf* q = p; q != NULL; q = q->next) {
+    recv_buf_write(f, q->payload, q->len);
+  }
+}
+
+// copy n bytes from the head of the receive ring to dst, a user
+// address if user_dst is 1, and drop them from the ring.
+// Return -1 if dst is bad. Caller must hold f->lock.
+int recv_buf_get(struct file* f, int user_dst, uint64 dst, int n) {
+  while (n > 0) {
+    uint off = f->rbuf_head % RBUF_SIZE;
+    int m = PGSIZE - off % PGSIZE;  // up to the end of the page
+    if (m > n) m = n;
+    if (either_copyout(user_dst, dst, f->rbuf[off / PGSIZE] + off % PGSIZE, m) < 0)
+      return -1;
+    f->rbuf_head += m;
+    dst += m;
+    n -= m;
+  }
+  return 0;
+}
+
+// allocate a struct file for a new socket, with an empty recv buf.
+// Return 0 if out of files or memory.
+struct file* alloc_socket_file(void) {
+  struct file* f = filealloc();
+  if (f == 0) {
+    return 0;
+  }
+  if (alloc_recv_buf(f) < 0) {
+    f->type = FD_NONE;
+    fileclose(f);
+    return 0;
+  }
+  f->type = FD_SOCKET;
+  f->pcb = 0;
+  f->upcb = 0;
+  f->cc = 0;
+  initlock(&f->lock, "socket");
+  f->readable = 1;
+  f->writable = 1;
+  f->status = PENDING;
+  f->aq_next = 0;
+  f->aq_head = 0;
+  f->aq_tail = 0;
+  return f;
+}
+
+// A buffer-cache block lent to lwIP by socket_sendfile(). lwIP
+// sends (and resends) straight from b->data, so b stays pinned in
+// the cache until the peer has acked pcb's bytes up to end.
+struct sfpin {
+  struct tcp_pcb* pcb;  // 0 if free
+  struct buf* b;        // 0 while reserved by socket_sendfile()
+  u32_t end;            // sequence number after the lent bytes
+};
+
+// at most half the cache is lent out; the rest is the file system's.
+#define NSFPIN (NBUF / 2)
+
+struct sfpin sfpins[NSFPIN];  // protected by net_lock
+
+// reserve a free sfpin for pcb. Return 0 if all are in use.
+// Caller must hold net_lock.
+struct sfpin* sfpin_alloc(struct tcp_pcb* pcb) {
+  for (struct sfpin* s = sfpins; s < sfpins + NSFPIN; s++) {
+    if (s->pcb == NULL) {
+      s->pcb = pcb;
+      s->b = NULL;
+      return s;
+    }
+  }
+  return NULL;
+}
+
+// unpin s's block, if any, and free s. Caller must hold net_lock.
+void sfpin_free(struct sfpin* s) {
+  if (s->b) bunpin(s->b);
+  s->b = NULL;
+  s->pcb = NULL;
+  wakeup(sfpins);
+}
+
+// give back the blocks lent to pcb that the peer has acked, or all
+// of them if pcb has gone (lwIP freed it; don't look into it).
+// Caller must hold net_lock.
+void sfpin_release(struct tcp_pcb* pcb, int gone) {
+  for (struct sfpin* s = sfpins; s < sfpins + NSFPIN; s++) {
+    if (s->pcb == pcb && s->b != NULL &&
+        (gone || TCP_SEQ_LEQ(s->end, pcb->lastack))) {
+      sfpin_free(s);
+    }
+  }
+}
+
+// whether pcb has blocks lent to it. Caller must hold net_lock.
+int sfpin_busy(struct tcp_pcb* pcb) {
+  for (struct sfpin* s = sfpins; s < sfpins + NSFPIN; s++) {
+    if (s->pcb == pcb && s->b != NULL) return 1;
+  }
+  return 0;
+}
+
+// lwIP callbacks for the pcb of a closed socket that still has
+// blocks lent to it; arg is the pcb itself.
+err_t sfpin_closed_sent(void* arg, struct tcp_pcb* tpcb, u16_t len) {
+  sfpin_release(tpcb, 0);
+  return ERR_OK;
+}
+
+void sfpin_closed_err(void* arg, err_t err) {
+  sfpin_release(arg, 1);
+}
 
+// whether lwIP still has pcb after a close.
+int tcp_pcb_alive(struct tcp_pcb* pcb) {
+  struct tcp_pcb* p;
+  for (p = tcp_active_pcbs; p != NULL; p = p->next) {
+    if (p == pcb) return 1;
+  }
+  for (p = tcp_tw_pcbs; p != NULL; p = p->next) {
+    if (p == pcb) return 1;
+  }
+  return 0;
+}
+
+/*-------------------- SOCKET FUNCTION ---------------------------*/
 // Create a new socekt. Currently, socket only supports
 // TCP and IPv4 protocol.
-int socket() {
+int socket(int type) {
   struct file* f;
   struct tcp_pcb* pcb;
   int fd;
 
-  acquire(&socket_lock);
+  if (type == SOCK_DGRAM) {
+    return dgram_socket();
+  }
+  if (type != SOCK_STREAM) {
+    return -1;
+  }
+
+  acquire(&net_lock);
   pcb = tcp_new();
-  release(&socket_lock);
+  release(&net_lock);
   if (pcb == NULL) {
     panic("not enough memory to create a new socket.\n");
   }
 
-  // allocate a file struct for socket
-  f = filealloc();
+  // allocate a file struct for socket, with its recv buf
+  f = alloc_socket_file();
   if (f == 0) {
     panic("fail to alloc struct file.\n");
   }
-  f->type = FD_SOCKET;
   f->pcb = pcb;
-  f->readable = 1;
-  f->writable = 1;
-  f->status = PENDING;
-
-  // initialize socekt recv buf
-  f->rbuf_size = 0;
-  f->rbuf_head = 0;
-  f->rbuf_tail = 0;
 
   // allocate a fd from current process and connect it to struct file f.
   fd = fdalloc(f);
@@ -89,16 +242,39 @@ int socket() {
   return fd;
 }
 
-// Close the connection of given socket.
+// Close the connection of given socket, and the connections
+// waiting in its accept queue if it listens.
 // TCP_PCB block will be freed automatically.
 int socket_close(struct file* f) {
-  struct tcp_pcb* pcb = f->pcb;
+  struct tcp_pcb* pcb;
+  struct file *q, *next;
   err_t res;
-  acquire(&socket_lock);
 
-  // clean recv buffer
-  while (f->rbuf_size != 0){
-    free_recv_buf_desc(f);
+  if (f->type == FD_DGRAM) {
+    return dgram_close(f);
+  }
+  acquire(&net_lock);
+
+  // lwIP has freed the pcb of a failed connection.
+  if ((pcb = f->pcb) == NULL) {
+    goto done;
+  }
+  f->pcb = NULL;
+
+  // f goes away now; keep lwIP from calling back with it. blocks
+  // lent by socket_sendfile() stay pinned until they are acked.
+  tcp_arg(pcb, NULL);
+  if (pcb->state == LISTEN) {
+    tcp_accept(pcb, NULL);
+  } else if (sfpin_busy(pcb)) {
+    tcp_arg(pcb, pcb);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, sfpin_closed_sent);
+    tcp_err(pcb, sfpin_closed_err);
+  } else {
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
   }
 
   while (1) {
@@ -106,15 +282,38 @@ int socket_close(struct file* f) {
     if (res == ERR_OK) {
       break;
     } else if (res == ERR_MEM) {
-      // wait and re-try close the connection
+      // wait and re-try close the connection. let the network
+      // thread run meanwhile; it is what frees memory.
+      release(&net_lock);
       for (int i = 0; i < 10000000; i++) {}
+      acquire(&net_lock);
     } else {
       printf("err: %d\n", res);
       panic("tcp_close() fails.");
     }
   }
+  // tcp_close() resets and frees the pcb right away if unread data
+  // is left, without calling back.
+  if (!tcp_pcb_alive(pcb)) {
+    sfpin_release(pcb, 1);
+  }
+done:
+  release(&net_lock);
+
+  // free recv buffer and accept queue
+  acquire(&f->lock);
+  free_recv_buf(f);
+  q = f->aq_head;
+  f->aq_head = 0;
+  f->aq_tail = 0;
+  release(&f->lock);
+
+  for (; q != 0; q = next) {
+    next = q->aq_next;
+    fileclose(q);
+  }
+
   printf("successfully close socket.\n");
-  release(&socket_lock);
   return 0;
 }
 
@@ -122,132 +321,371 @@ int socket_close(struct file* f) {
 // Callback function when data has been received.
 // This function will copy data from pbuf to socket recv buf,
 // and notify proc for new available data. Also it will
-// optionally free pbuf.
+// optionally free pbuf. If the recv buf is too full, it refuses
+// the pbuf: lwIP holds on to it, the advertised window stays
+// closed by what is unread, and socket_read() hands it back.
 err_t tcp_recv_packet(void* arg, struct tcp_pcb* tpcb, struct pbuf* p,
                       err_t err) {
-  acquire(&socket_lock); // IMPORTANT. Because recv_buf is not thread safe
   struct file* f = arg;
+  acquire(&f->lock); // IMPORTANT. Because recv_buf is not thread safe
 
   if (err != ERR_OK) { 
     printf("tcp_recv callbacl Err = %d\n", err);
     if (err == ERR_ABRT) pbuf_free(p);
     f->status = FAILURE;
-    release(&socket_lock);
+    release(&f->lock);
     wakeup(f); // If a socket_read() is blocked and waiting for packet, notify it.
                // else, we just ignore this error incoming packet.
+    pollwakeup();
+    epollnotify(f);
     return err;
   }
 
-  // Recv buf is full. Data loss here. 
-  // We prevent this error by increasing BUF_SIZE
-  int idx = alloc_recv_buf_desc(f);
-  if (idx == -1) {
-    panic("socket recv buffer is full. Needs to increase BUF_SIZE");
-  }
-
   if (p == NULL) {
     //printf("TCP connection is closed by remote host.\n");
     f->status = CON_CLOSED;
-    release(&socket_lock);
+    release(&f->lock);
     wakeup(f);
+    pollwakeup();
+    epollnotify(f);
     return ERR_CLSD;
   }
 
-  // Extract data from pbuf to recv_desc_buf
-  if (p->tot_len > PGSIZE) {
-    panic("packet is larger than one pagesize.");
-  }
-  f->rbuf[idx].len = p->tot_len;
-  struct pbuf* ptr = p;
-  int offset = 0;
-  while (ptr != NULL) {
-    memmove((void*)f->rbuf[idx].addr + offset, (const void*)ptr->payload,
-            ptr->len);
-    offset += ptr->len;
-    ptr = ptr->next;
+  // Recv buf is full. Keep p in lwIP until socket_read()
+  // makes room; the peer is throttled by the TCP window.
+  if (p->tot_len > RBUF_SIZE - recv_buf_used(f)) {
+    release(&f->lock);
+    return ERR_MEM;
   }
 
+  // Extract data from pbuf to recv buf
+  recv_buf_put(f, p);
+
   pbuf_free(p);
   f->status = SUCCESS;
-  release(&socket_lock);
+  release(&f->lock);
   wakeup(f);
+  pollwakeup();
+  epollnotify(f);
  
   return err;
 }
 
 // Read up to n bytes from socket to buf.
-// This function will block until data is available.
+// This function will block until data is available,
+// unless the socket is non-blocking.
 // Return the num of bytes that it gets,
 // Return -1 if error happens.
 int socket_read(struct file* f, uint64 buf, int n) {
-  struct tcp_pcb* pcb = f->pcb;
-  acquire(&socket_lock);
+  struct iovec iov;
 
   if (n <= 0) {
     panic("invalid length of data for socket_read().");
   }
+  iov.iov_base = (void*)buf;
+  iov.iov_len = n;
+  return socket_readv(f, &iov, 1);
+}
 
-  // wait for available data
-  f->status = PENDING;
-  while (f->rbuf_size == 0) {
-    sleep(f, &socket_lock);
+// Like socket_read(), but scatter the data over the cnt buffers of
+// iov[], filling each before the next.
+int socket_readv(struct file* f, struct iovec* iov, int cnt) {
+  int n = 0;
+  for (int i = 0; i < cnt; i++) n += iov[i].iov_len;
+
+  acquire(&f->lock);
+
+  // wait for available data. what was received before
+  // an error or the close is still handed out.
+  while (recv_buf_used(f) == 0) {
     if (f->status == FAILURE) {  // Error happens in packing receving.
-      release(&socket_lock);
+      release(&f->lock);
       return -1;
     }
     if (f->status == CON_CLOSED) {  // TCP connection is closed
-      free_recv_buf_desc(f);
-      release(&socket_lock);
+      release(&f->lock);
+      return -1;
+    }
+    if (f->nonblock) {
+      release(&f->lock);
       return -1;
     }
+    sleep(f, &f->lock);
   }
 
-  // copyout data from socket kernel recv buf to buf
-  int packet_len = f->rbuf[(f->rbuf_head) % BUF_SIZE].len;
-  void* krecv_buf = (void*)f->rbuf[(f->rbuf_head) % BUF_SIZE].addr;
-  int copy_len = packet_len > n ? n : packet_len;
-  copyout(myproc()->pagetable, buf, krecv_buf, copy_len);
-
-  // get all the data, free this recv_buf_desc
-  if (copy_len == packet_len) {
-    free_recv_buf_desc(f);
-    tcp_recved(pcb, packet_len);  // notify lwip to allow new packet come in.
-  } else {  // some data remains, update this recv_buf_desc
-    memmove(krecv_buf, krecv_buf + copy_len, packet_len - copy_len);
-    f->rbuf[(f->rbuf_head) % BUF_SIZE].len -= copy_len;
+  // copyout data from socket kernel recv buf to the buffers.
+  // a bad buffer ends the copy; what was copied before it counts.
+  int avail = recv_buf_used(f);
+  int left = avail < n ? avail : n;
+  for (int i = 0; left > 0; i++) {
+    int m = iov[i].iov_len;
+    if (m > left) m = left;
+    if (recv_buf_get(f, 1, (uint64)iov[i].iov_base, m) < 0) break;
+    left -= m;
   }
+  int copy_len = avail - recv_buf_used(f);
+  release(&f->lock);
 
-  release(&socket_lock);
+  // notify lwip to allow new packet come in, and take the data
+  // refused while recv buf was full.
+  acquire(&net_lock);
+  struct tcp_pcb* pcb = f->pcb;
+  if (pcb != NULL && copy_len > 0) {  // not failed
+    // tcp_recved() takes at most 0xffff at a time.
+    for (int left = copy_len; left > 0; left -= 0xffff) {
+      tcp_recved(pcb, left > 0xffff ? 0xffff : left);
+    }
+    if (pcb->refused_data != NULL) tcp_process_refused_data(pcb);
+  }
+  release(&net_lock);
+  if (copy_len == 0) {
+    return -1;
+  }
   return copy_len;
 }
 
-// Send n bytes from buf to socket. This function will not block during sending data.
-// It will try to enqueue data to sending queue. If fails, it returns -1;
-// If successful, return the num of bytes that it sends.
+// Callback function when sent data has been acked by remote host.
+// It wakes up writers waiting for space in the send buffer, once
+// there is enough of it to be worth a try (as lwIP's own sockets do).
+// Called by lwIP, with net_lock held.
+err_t tcp_sent_packet(void* arg, struct tcp_pcb* tpcb, u16_t len) {
+  struct file* f = arg;
+
+  sfpin_release(tpcb, 0);
+  if (tcp_sndbuf(tpcb) >= TCP_SNDLOWAT &&
+      tcp_sndqueuelen(tpcb) < TCP_SNDQUEUELOWAT) {
+    wakeup(&f->pcb);  // writers sleep on &f->pcb
+    pollwakeup();
+    epollnotify(f);
+  }
+  return ERR_OK;
+}
+
+// Send n bytes from buf to socket. This function blocks while lwIP's
+// send buffer is full, until all n bytes are queued for sending. A
+// non-blocking socket queues what fits and returns.
+// Return the num of bytes that it sends; -1 if error happens before
+// any data is sent.
 int socket_write(struct file* f, uint64 data, int n) {
-  struct tcp_pcb* pcb = f->pcb;
-  acquire(&socket_lock);
-  
+  struct iovec iov;
+
   if (n <= 0) {
     panic("invalid length of data for socket_write().");
   }
+  iov.iov_base = (void*)data;
+  iov.iov_len = n;
+  return socket_writev(f, &iov, 1);
+}
+
+// Like socket_write(), but gather the data from the cnt buffers of
+// iov[]. All of it is queued in lwIP as one batch before a single
+// tcp_output(), so that a header and a body given apart can still
+// go out in the same segment.
+// Data is copied into lwIP straight from the user pages.
+int socket_writev(struct file* f, struct iovec* iov, int cnt) {
+  struct tcp_pcb* pcb;
+  pagetable_t pagetable = myproc()->pagetable;
+  err_t err = ERR_OK;
+  int sent = 0, n = 0;
+  int i = 0;      // the buffer being sent
+  uint64 done = 0;  // bytes of iov[i] sent
+
+  for (int j = 0; j < cnt; j++) n += iov[j].iov_len;
+
+  acquire(&net_lock);
+  while (sent < n) {
+    if ((pcb = f->pcb) == NULL || myproc()->killed) {  // failed
+      err = ERR_ABRT;
+      break;
+    }
+
+    // send buffer is full. push out what is queued and wait
+    // for the remote host to ack some of it.
+    if (tcp_sndbuf(pcb) == 0 || tcp_sndqueuelen(pcb) >= TCP_SND_QUEUELEN) {
+      tcp_output(pcb);
+      if (f->nonblock) {
+        err = ERR_WOULDBLOCK;
+        break;
+      }
+      sleep(&f->pcb, &net_lock);
+      continue;
+    }
+
+    if (done == iov[i].iov_len) {  // on to the next buffer
+      i++;
+      done = 0;
+      continue;
+    }
+
+    // at most up to the end of the user page.
+    uint64 data = (uint64)iov[i].iov_base + done;
+    uint64 va0 = PGROUNDDOWN(data);
+    uint64 pa0 = walkaddr(pagetable, va0);
+    if (pa0 == 0) {
+      err = ERR_ARG;
+      break;
+    }
+    int off = data - va0;
+    int len = PGSIZE - off;
+    if (len > iov[i].iov_len - done) len = iov[i].iov_len - done;
+    if (len > tcp_sndbuf(pcb)) len = tcp_sndbuf(pcb);
+
+    u8_t flags = TCP_WRITE_FLAG_COPY;
+    if (sent + len < n) flags |= TCP_WRITE_FLAG_MORE;
+    err = tcp_write(pcb, (void*)(pa0 + off), len, flags);
+    if (err == ERR_MEM && !f->nonblock &&
+        (pcb->unsent != NULL || pcb->unacked != NULL)) {
+      // out of segments; acks will free some.
+      tcp_output(pcb);
+      sleep(&f->pcb, &net_lock);
+      continue;
+    }
+    if (err != ERR_OK) {
+      break;
+    }
+    sent += len;
+    done += len;
+  }
+  if ((pcb = f->pcb) != NULL) {
+    tcp_output(pcb);
+  }
+  release(&net_lock);
 
-  if (n > PGSIZE) {
-    panic("packet is larger than one pagesize.");
+  if (sent == 0 && err != ERR_OK) {
+    return -1;
   }
+  return sent;
+}
+
+// Send n bytes of inode ip's data, from offset off, to socket f.
+// The data is not copied: each block is pinned in the buffer cache
+// and handed to lwIP by reference until the peer acks it. Blocks
+// like socket_write(); a non-blocking socket sends what fits.
+// Return the num of bytes that it sends; -1 if error happens before
+// any data is sent.
+int socket_sendfile(struct file* f, struct inode* ip, uint off, int n) {
+  struct tcp_pcb* pcb;
+  struct sfpin* s;
+  err_t err = ERR_OK;
+  int sent = 0;
+
+  acquire(&net_lock);
+  while (sent < n) {
+    if ((pcb = f->pcb) == NULL || myproc()->killed) {  // failed
+      err = ERR_ABRT;
+      break;
+    }
+
+    // send buffer is full. push out what is queued and wait
+    // for the remote host to ack some of it.
+    if (tcp_sndbuf(pcb) == 0 || tcp_sndqueuelen(pcb) >= TCP_SND_QUEUELEN) {
+      tcp_output(pcb);
+      if (f->nonblock) {
+        err = ERR_WOULDBLOCK;
+        break;
+      }
+      sleep(&f->pcb, &net_lock);
+      continue;
+    }
+
+    // all the blocks we may lend are out; wait for acks of some.
+    if ((s = sfpin_alloc(pcb)) == NULL) {
+      tcp_output(pcb);
+      if (f->nonblock) {
+        err = ERR_WOULDBLOCK;
+        break;
+      }
+      sleep(sfpins, &net_lock);
+      continue;
+    }
 
-  void* k_buf = kalloc();
-  copyin(myproc()->pagetable, k_buf, data, n);
-  err_t err = tcp_write(pcb, k_buf, n, TCP_WRITE_FLAG_COPY);
-  kfree(k_buf);
+    // at most up to the end of the block.
+    int len = BSIZE - off % BSIZE;
+    if (len > n - sent) len = n - sent;
 
-  release(&socket_lock);
-  return err == ERR_OK ? n : -1;
+    // reading the block may wait for the disk.
+    release(&net_lock);
+    ilock(ip);
+    if (off >= ip->size) {
+      iunlock(ip);
+      acquire(&net_lock);
+      sfpin_free(s);
+      break;
+    }
+    if (len > ip->size - off) len = ip->size - off;
+    s->b = ipinblock(ip, off);
+    iunlock(ip);
+    acquire(&net_lock);
+
+    if ((pcb = f->pcb) == NULL) {
+      sfpin_free(s);
+      err = ERR_ABRT;
+      break;
+    }
+    if (len > tcp_sndbuf(pcb)) len = tcp_sndbuf(pcb);
+    if (len == 0) {  // another writer took the room meanwhile
+      sfpin_free(s);
+      continue;
+    }
+
+    u8_t flags = 0;
+    if (sent + len < n) flags |= TCP_WRITE_FLAG_MORE;
+    err = tcp_write(pcb, s->b->data + off % BSIZE, len, flags);
+    if (err != ERR_OK) {
+      sfpin_free(s);
+      if (err == ERR_MEM && !f->nonblock &&
+          (pcb->unsent != NULL || pcb->unacked != NULL)) {
+        // out of segments; acks will free some.
+        tcp_output(pcb);
+        sleep(&f->pcb, &net_lock);
+        continue;
+      }
+      break;
+    }
+    s->end = pcb->snd_lbb;
+    sent += len;
+    off += len;
+  }
+  if ((pcb = f->pcb) != NULL) {
+    tcp_output(pcb);
+  }
+  release(&net_lock);
+
+  if (sent == 0 && err != ERR_OK) {
+    return -1;
+  }
+  return sent;
+}
+
+// Which poll events apply to socket f now: POLLIN if there is
+// data or a connection to accept, or the peer closed; POLLOUT if
+// connected with room in lwIP's send buffer.
+int socket_poll(struct file* f) {
+  struct tcp_pcb* pcb;
+  int r = 0;
+
+  if (f->type == FD_DGRAM) {
+    return dgram_poll(f);
+  }
+  acquire(&net_lock);
+  pcb = f->pcb;
+  if (pcb != NULL && (pcb->state == ESTABLISHED || pcb->state == CLOSE_WAIT) &&
+      tcp_sndbuf(pcb) > 0 && tcp_sndqueuelen(pcb) < TCP_SND_QUEUELEN) {
+    r |= POLLOUT;
+  }
+  acquire(&f->lock);
+  if (recv_buf_used(f) > 0 || f->aq_head != 0) r |= POLLIN;
+  if (f->status == CON_CLOSED) r |= POLLIN | POLLHUP;
+  if (f->status == FAILURE) r |= POLLERR | POLLHUP;
+  release(&f->lock);
+  release(&net_lock);
+  return r;
 }
 
 /*-------------------- CLIENT SIDE FUNCTION ---------------------------*/
 // This function will be called when tcp connection is established.
 // It will setup recv callback for this socekt.
+// Called by lwIP, with net_lock held.
 err_t tcp_connect_success(void* arg, struct tcp_pcb* tpcb, err_t err) {
   printf("tcp connection builds successfully.\n");
   struct file* f = arg;
@@ -256,34 +694,47 @@ err_t tcp_connect_success(void* arg, struct tcp_pcb* tpcb, err_t err) {
     panic("arg and tpcv do not match in callback fn.");
   }
 
-  f->status = SUCCESS;
-
-  acquire(&socket_lock);
   tcp_arg(f->pcb, f);
   tcp_recv(f->pcb, tcp_recv_packet);
-  release(&socket_lock);
+  tcp_sent(f->pcb, tcp_sent_packet);
 
+  acquire(&f->lock);
+  f->status = SUCCESS;
   wakeup(f);
+  release(&f->lock);
+  pollwakeup();
+  epollnotify(f);
   return err;
 }
 
 // Error callback function for tcp pcb block. This function will be called,
-// when fatal errors happen in tcp connection.
+// when fatal errors happen in tcp connection. lwIP has freed the pcb.
+// Called by lwIP, with net_lock held.
 void tcp_connect_failure(void* arg, err_t err) {
   printf("tcp connection fails because err = %d.\n", err);
   struct file* f = arg;
+  sfpin_release(f->pcb, 1);  // lwIP has freed it
+  f->pcb = NULL;
+  acquire(&f->lock);
   f->status = FAILURE;
   wakeup(f);
+  release(&f->lock);
+  wakeup(&f->pcb);  // writers
+  pollwakeup();
+  epollnotify(f);
 }
 
 // Create a connection to specific {ip,port}.
 // It will keep blocking until connection is established.
 // Return 0 when succeed, otherwise it will panic the error infomation.
 int socket_connect(struct file* f, uint32 ip, uint16 prot) {
+  if (f->type == FD_DGRAM) {
+    return dgram_connect(f, ip, prot);
+  }
   struct tcp_pcb* pcb = f->pcb;
   tcp_connected_fn success_fn = tcp_connect_success;
   f->status = PENDING;
-  acquire(&socket_lock);
+  acquire(&net_lock);
 
   // setup failure call back
   tcp_err_fn failure_fn = tcp_connect_failure;
@@ -298,13 +749,23 @@ int socket_connect(struct file* f, uint32 ip, uint16 prot) {
     printf("err = %d", res);
     panic("Error when calling tcp_connect");
   }
-  sleep(f, &socket_lock);
-  release(&socket_lock);
+  // a non-blocking socket is writable (POLLOUT) once connected.
+  if (f->nonblock) {
+    release(&net_lock);
+    return 0;
+  }
+
+  // the callbacks run under net_lock, so they cannot slip in
+  // between here and the sleep.
+  acquire(&f->lock);
+  release(&net_lock);
+  while (f->status == PENDING) {
+    sleep(f, &f->lock);
+  }
+  release(&f->lock);
 
   if (f->status == FAILURE) {  // TCP connect fails
     return -1;
-  } else if (f->status == PENDING) {
-    panic("incorrect status value.");
   }
 
   return 0;
@@ -313,87 +774,375 @@ int socket_connect(struct file* f, uint32 ip, uint16 prot) {
 /*-------------------- SERVER SIDE FUNCTION ---------------------------*/
 // Bind given socekt to specific {ip,port}
 int socket_bind(struct file* f, uint32 ip, uint16 port) {
+  if (f->type == FD_DGRAM) {
+    return dgram_bind(f, ip, port);
+  }
   struct tcp_pcb* pcb = f->pcb;
-  acquire(&socket_lock);
+  acquire(&net_lock);
+
+  if ((pcb = f->pcb) == NULL) {
+    release(&net_lock);
+    return -1;
+  }
 
   err_t res = tcp_bind(pcb, (ip_addr_t*)&ip, port);
   if (res != ERR_OK) {
     printf("res = %d", res);
     //panic("Error when calling tcp_bind");
+    release(&net_lock);
     return res;
   }
 
-  release(&socket_lock);
+  release(&net_lock);
   return ERR_OK;
 }
 
-// Set the state of the connection to be LISTEN,
-// which means that it is able to accept incoming connections.
-// Return 0 if successful. Return -1 for errors.
-int socket_listen(struct file* f) {
-  struct tcp_pcb* pcb = f->pcb;
-  acquire(&socket_lock);
+// Make the congestion control algorithm called name ("newreno",
+// "cubic") that of socket f, and of the connections it accepts
+// from now on. Return -1 if there is no such algorithm.
+int socket_setcc(struct file* f, char* name) {
+  const struct tcp_cc_ops* cc;
 
-  pcb = tcp_listen_with_backlog(pcb, TCP_DEFAULT_LISTEN_BACKLOG);
-  if (pcb == NULL) {
-    printf("No memory was available for the listening connection.\n");
-    release(&socket_lock);
+  if (f->type != FD_SOCKET) {
     return -1;
   }
-  f->pcb = pcb;
-
-  release(&socket_lock);
+  acquire(&net_lock);
+  if ((cc = tcp_cc_find(name)) == NULL) {
+    release(&net_lock);
+    return -1;
+  }
+  f->cc = cc;
+  if (f->pcb != NULL && f->pcb->state != LISTEN) {
+    tcp_set_cc(f->pcb, cc);
+  }
+  release(&net_lock);
   return 0;
 }
 
 // This function will be called when tcp aceept successfully.
-// It will generate a new socket for the new connection.
+// It will generate a new socket for the new connection and put
+// it on the accept queue of listening socket arg.
 // Note that this func will be called by kernel lwip stack, which does not belong to any proc.
+// Called with net_lock held.
 err_t tcp_accept_success(void* arg, struct tcp_pcb* newpcb, err_t err) {
-  struct file* f=arg;
+  struct file* f = arg;
+  struct file* new_f;
 
-  printf("tcp accept successfully.\n");
-  f->pcb = newpcb;
+  if (err != ERR_OK || newpcb == NULL) {
+    return ERR_VAL;
+  }
+  // lwIP aborts the new connection if we fail.
+  if ((new_f = alloc_socket_file()) == 0) {
+    printf("tcp accept: no memory for new socket.\n");
+    return ERR_MEM;
+  }
+  new_f->pcb = newpcb;
+  new_f->status = SUCCESS;
+  if (f->cc != NULL) {
+    new_f->cc = f->cc;
+    tcp_set_cc(newpcb, f->cc);
+  }
 
-  acquire(&socket_lock);
-  tcp_arg(f->pcb, f);
-  tcp_recv(f->pcb, tcp_recv_packet);
-  release(&socket_lock);
+  tcp_arg(newpcb, new_f);
+  tcp_recv(newpcb, tcp_recv_packet);
+  tcp_sent(newpcb, tcp_sent_packet);
+  tcp_err(newpcb, tcp_connect_failure);
+
+  // keep counting it against the backlog until socket_accept().
+  tcp_backlog_delayed(newpcb);
 
+  acquire(&f->lock);
+  if (f->aq_tail) {
+    f->aq_tail->aq_next = new_f;
+  } else {
+    f->aq_head = new_f;
+  }
+  f->aq_tail = new_f;
   wakeup(f);
-  return err;
+  release(&f->lock);
+  pollwakeup();
+  epollnotify(f);
+  return ERR_OK;
+}
+
+// Set the state of the connection to be LISTEN,
+// which means that it is able to accept incoming connections.
+// Up to backlog connections (TCP_DEFAULT_LISTEN_BACKLOG if backlog
+// is not positive) may be waiting for socket_accept(), counting
+// those still being set up; lwIP turns away the rest.
+// Return 0 if successful. Return -1 for errors.
+int socket_listen(struct file* f, int backlog) {
+  struct tcp_pcb* pcb;
+  if (f->type != FD_SOCKET) {
+    return -1;
+  }
+  acquire(&net_lock);
+
+  if (backlog <= 0 || backlog > TCP_DEFAULT_LISTEN_BACKLOG) {
+    backlog = TCP_DEFAULT_LISTEN_BACKLOG;
+  }
+  if ((pcb = f->pcb) == NULL) {
+    release(&net_lock);
+    return -1;
+  }
+  pcb = tcp_listen_with_backlog(pcb, backlog);
+  if (pcb == NULL) {
+    printf("No memory was available for the listening connection.\n");
+    release(&net_lock);
+    return -1;
+  }
+  f->pcb = pcb;
+
+  // new connections go on f's accept queue.
+  tcp_arg(pcb, f);
+  tcp_accept(pcb, tcp_accept_success);
+
+  release(&net_lock);
+  return 0;
 }
 
 // Accept connection from other host, and return a new socket
 // for each new connection. This function will block until
-// new connection is accepted.
+// a connection is on the accept queue, unless the socket is
+// non-blocking.
 int socket_accept(struct file* f) {
+  struct file* new_f;
   int new_fd = -1;
-  tcp_accept_fn success_fn = tcp_accept_success;
-  struct tcp_pcb* pcb = f->pcb;
-  struct file* new_f = filealloc();
-  if (new_f == 0) {
-    panic("fail to alloc struct file.\n");
-  }
-  new_f->type = FD_SOCKET;
-  new_f->readable = 1;
-  new_f->writable = 1;
-  
-  acquire(&socket_lock);
-
-  // setup args for all the call back function
-  // here, pcb addr is unique, only accept() wait for this channel
-  tcp_arg(pcb, new_f);
 
-  // setup callback
-  tcp_accept(pcb, success_fn);
-  sleep(new_f, &socket_lock);
+  if (f->type != FD_SOCKET) {
+    return -1;
+  }
+  acquire(&f->lock);
+  while ((new_f = f->aq_head) == 0) {
+    if (myproc()->killed || f->nonblock) {
+      release(&f->lock);
+      return -1;
+    }
+    sleep(f, &f->lock);
+  }
+  f->aq_head = new_f->aq_next;
+  if (f->aq_head == 0) {
+    f->aq_tail = 0;
+  }
+  new_f->aq_next = 0;
+  release(&f->lock);
 
-  release(&socket_lock);
+  // make room in the backlog.
+  acquire(&net_lock);
+  if (new_f->pcb != NULL) {
+    tcp_backlog_accepted(new_f->pcb);
+  }
+  release(&net_lock);
 
   new_fd = fdalloc(new_f);
   if (new_fd == -1) {
-    panic("fail to alloc fd for struct file.\n");
+    fileclose(new_f);
+    return -1;
   }
   return new_fd;
 }
+
+/*-------------------- DATAGRAM FUNCTION ---------------------------*/
+// A UDP socket is an FD_DGRAM file. Its receive ring holds a queue
+// of datagrams, each a struct dgram followed by the payload.
+struct dgram {
+  uint16 len;    // bytes of payload
+  uint16 port;   // sender's port
+  uint32 addr;   // sender's IPv4 address, net order
+};
+
+// Callback function when a datagram has arrived. It is queued
+// whole, or dropped if the queue has no room for it.
+// Called by lwIP, with net_lock held.
+void udp_recv_packet(void* arg, struct udp_pcb* pcb, struct pbuf* p,
+                     const ip_addr_t* addr, u16_t port) {
+  struct file* f = arg;
+  struct dgram d;
+
+  acquire(&f->lock);
+  if (RBUF_SIZE - recv_buf_used(f) < sizeof(d) + p->tot_len) {
+    release(&f->lock);
+    pbuf_free(p);
+    return;
+  }
+  d.len = p->tot_len;
+  d.port = port;
+  d.addr = ip4_addr_get_u32(ip_2_ip4(addr));
+  recv_buf_write(f, (char*)&d, sizeof(d));
+  recv_buf_put(f, p);
+  release(&f->lock);
+  pbuf_free(p);
+  wakeup(f);
+  pollwakeup();
+  epollnotify(f);
+}
+
+// Create a new UDP socket.
+// Return its fd, or -1 if out of memory or files.
+int dgram_socket(void) {
+  struct file* f;
+  struct udp_pcb* pcb;
+  int fd;
+
+  acquire(&net_lock);
+  pcb = udp_new();
+  release(&net_lock);
+  if (pcb == NULL) {
+    return -1;
+  }
+
+  if ((f = alloc_socket_file()) == 0) {
+    acquire(&net_lock);
+    udp_remove(pcb);
+    release(&net_lock);
+    return -1;
+  }
+  f->type = FD_DGRAM;
+  f->upcb = pcb;
+  acquire(&net_lock);
+  udp_recv(pcb, udp_recv_packet, f);
+  release(&net_lock);
+
+  if ((fd = fdalloc(f)) < 0) {
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+// Close UDP socket f, dropping the datagrams queued for it.
+int dgram_close(struct file* f) {
+  acquire(&net_lock);
+  if (f->upcb != NULL) {
+    udp_remove(f->upcb);
+    f->upcb = NULL;
+  }
+  release(&net_lock);
+
+  acquire(&f->lock);
+  free_recv_buf(f);
+  release(&f->lock);
+  return 0;
+}
+
+// Receive datagrams on local {ip,port}.
+int dgram_bind(struct file* f, uint32 ip, uint16 port) {
+  err_t err;
+
+  acquire(&net_lock);
+  err = udp_bind(f->upcb, (ip_addr_t*)&ip, port);
+  release(&net_lock);
+  return err == ERR_OK ? 0 : -1;
+}
+
+// Make {ip,port} the peer that datagrams without an address go
+// to, and the only one that datagrams are taken from.
+int dgram_connect(struct file* f, uint32 ip, uint16 port) {
+  err_t err;
+
+  acquire(&net_lock);
+  err = udp_connect(f->upcb, (ip_addr_t*)&ip, port);
+  release(&net_lock);
+  return err == ERR_OK ? 0 : -1;
+}
+
+// Which poll events apply to UDP socket f now: POLLIN if a
+// datagram is queued; POLLOUT always, as sends do not wait.
+int dgram_poll(struct file* f) {
+  int r = POLLOUT;
+
+  acquire(&f->lock);
+  if (recv_buf_used(f) > 0) r |= POLLIN;
+  release(&f->lock);
+  return r;
+}
+
+// Send the n datagrams of msg[] from UDP socket f, copying each
+// payload from user space into a pbuf for lwIP. Stop at the first
+// that cannot be sent.
+// Return the number sent; -1 if the first fails.
+int socket_sendmmsg(struct file* f, struct mmsghdr* msg, int n) {
+  pagetable_t pagetable = myproc()->pagetable;
+  struct pbuf *p, *q;
+  ip_addr_t addr;
+  err_t err = ERR_OK;
+  int i;
+
+  acquire(&net_lock);
+  for (i = 0; i < n; i++) {
+    if (msg[i].msg_len > 0xffff - sizeof(struct udp_hdr)) {
+      break;
+    }
+    p = pbuf_alloc(PBUF_TRANSPORT, msg[i].msg_len, PBUF_POOL);
+    if (p == NULL) {
+      // the NIC may be done with earlier ones.
+      virtio_net_reclaim();
+      p = pbuf_alloc(PBUF_TRANSPORT, msg[i].msg_len, PBUF_POOL);
+      if (p == NULL) break;
+    }
+    uint64 src = (uint64)msg[i].msg_buf;
+    for (q = p; q != NULL; q = q->next) {
+      if (copyin(pagetable, q->payload, src, q->len) < 0) break;
+      src += q->len;
+    }
+    if (q != NULL) {  // bad payload address
+      pbuf_free(p);
+      break;
+    }
+
+    if (msg[i].msg_addr == 0) {
+      err = udp_send(f->upcb, p);
+    } else {
+      ip_addr_set_ip4_u32(&addr, msg[i].msg_addr);
+      err = udp_sendto(f->upcb, p, &addr, msg[i].msg_port);
+    }
+    pbuf_free(p);
+    if (err != ERR_OK) break;
+  }
+  // hand datagrams to this host (127.0.0.1, or our own address)
+  // to their sockets now, rather than on netd's next pass.
+  netloop();
+  release(&net_lock);
+
+  if (i == 0) {
+    return -1;
+  }
+  return i;
+}
+
+// Receive up to n datagrams on UDP socket f into msg[], each
+// truncated to the room its msg_len gives. Blocks until there is
+// one, unless the socket is non-blocking; then takes only those
+// already queued.
+// Return the number received, or -1.
+int socket_recvmmsg(struct file* f, struct mmsghdr* msg, int n) {
+  struct dgram d;
+  int i;
+
+  acquire(&f->lock);
+  while (recv_buf_used(f) == 0) {
+    if (f->nonblock || myproc()->killed) {
+      release(&f->lock);
+      return -1;
+    }
+    sleep(f, &f->lock);
+  }
+
+  for (i = 0; i < n && recv_buf_used(f) > 0; i++) {
+    recv_buf_get(f, 0, (uint64)&d, sizeof(d));
+    uint start = f->rbuf_head;
+    int m = d.len;
+    if (m > msg[i].msg_len) m = msg[i].msg_len;
+    if (recv_buf_get(f, 1, (uint64)msg[i].msg_buf, m) < 0) {
+      // a bad buffer loses the datagram, as a short one loses
+      // its tail.
+      m = 0;
+    }
+    f->rbuf_head = start + d.len;
+    msg[i].msg_len = m;
+    msg[i].msg_addr = d.addr;
+    msg[i].msg_port = d.port;
+  }
+  release(&f->lock);
+  return i;
+}
@@ -0,0 +1,15 @@
+// socket() types
+#define SOCK_STREAM  1  // TCP
+#define SOCK_DGRAM   2  // UDP
+
+// a datagram of sendmmsg()/recvmmsg()
+struct mmsghdr {
+  void *msg_buf;    // the payload
+  uint msg_len;     // its length. for recvmmsg(), the room in msg_buf,
+                    // set to the bytes received
+  uint32 msg_addr;  // peer IPv4 address, net order; for sendmmsg(),
+                    // 0 means the peer of socket_connect()
+  uint16 msg_port;  // peer port
+};
+
+#define MMSG_MAX  32  // most datagrams in one sendmmsg()/recvmmsg()
@@ -112,6 +112,17 @@ extern uint64 sys_socket_bind(void);
 extern uint64 sys_socket_listen(void);
 extern uint64 sys_socket_accept(void);
 extern uint64 sys_dns_api_gethostbyname(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_epoll_create(void);
+extern uint64 sys_epoll_ctl(void);
+extern uint64 sys_epoll_wait(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_sendmmsg(void);
+extern uint64 sys_recvmmsg(void);
+extern uint64 sys_socket_setcc(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -142,7 +153,18 @@ static uint64 (*syscalls[])(void) = {
 [SYS_socket_bind]  sys_socket_bind,
 [SYS_socket_listen]  sys_socket_listen,
 [SYS_socket_accept]  sys_socket_accept,
-[SYS_dns_api_gethostbyname] sys_dns_api_gethostbyname
+[SYS_dns_api_gethostbyname] sys_dns_api_gethostbyname,
+[SYS_fcntl]   sys_fcntl,
+[SYS_poll]    sys_poll,
+[SYS_epoll_create] sys_epoll_create,
+[SYS_epoll_ctl]    sys_epoll_ctl,
+[SYS_epoll_wait]   sys_epoll_wait,
+[SYS_sendfile]     sys_sendfile,
+[SYS_readv]        sys_readv,
+[SYS_writev]       sys_writev,
+[SYS_sendmmsg]     sys_sendmmsg,
+[SYS_recvmmsg]     sys_recvmmsg,
+[SYS_socket_setcc] sys_socket_setcc,
 };
 
 void
@@ -34,3 +34,16 @@
 
 // System calls for socket
 #define SYS_dns_api_gethostbyname 29
+
+// System calls for non-blocking I/O
+#define SYS_fcntl  30
+#define SYS_poll   31
+#define SYS_epoll_create 32
+#define SYS_epoll_ctl    33
+#define SYS_epoll_wait   34
+#define SYS_sendfile     35
+#define SYS_readv        36
+#define SYS_writev       37
+#define SYS_sendmmsg     38
+#define SYS_recvmmsg     39
+#define SYS_socket_setcc 40
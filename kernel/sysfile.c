@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "poll.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -488,3 +490,176 @@ sys_pipe(void)
   return 0;
 }
 
+// Get or set the flags of an open file. Only O_NONBLOCK can be
+// set, and only on sockets.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+
+  switch(cmd){
+  case F_GETFL:
+    return f->nonblock ? O_NONBLOCK : 0;
+  case F_SETFL:
+    if((arg & O_NONBLOCK) && f->type != FD_SOCKET && f->type != FD_DGRAM)
+      return -1;
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
+uint64
+sys_poll(void)
+{
+  struct pollfd pfd[NOFILE];
+  uint64 fds; // user pointer to array of struct pollfd
+  int nfds, timeout, n;
+  struct proc *p = myproc();
+
+  if(argaddr(0, &fds) < 0 || argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(nfds < 0 || nfds > NOFILE)
+    return -1;
+  if(copyin(p->pagetable, (char*)pfd, fds, nfds * sizeof(pfd[0])) < 0)
+    return -1;
+  n = filepoll(pfd, nfds, timeout);
+  if(copyout(p->pagetable, fds, (char*)pfd, nfds * sizeof(pfd[0])) < 0)
+    return -1;
+  return n;
+}
+
+uint64
+sys_epoll_create(void)
+{
+  struct file *f;
+  struct eventpoll *ep;
+  int fd;
+
+  if((ep = epollalloc()) == 0)
+    return -1;
+  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
+    if(f)
+      fileclose(f);
+    epollclose(ep);
+    return -1;
+  }
+  f->type = FD_EPOLL;
+  f->readable = 0;
+  f->writable = 0;
+  f->ep = ep;
+  return fd;
+}
+
+uint64
+sys_epoll_ctl(void)
+{
+  struct file *epf, *f;
+  struct epoll_event ev;
+  uint64 uev; // user pointer to struct epoll_event
+  int op, fd;
+
+  if(argfd(0, 0, &epf) < 0 || argint(1, &op) < 0 || argfd(2, &fd, &f) < 0 ||
+     argaddr(3, &uev) < 0)
+    return -1;
+  if(epf->type != FD_EPOLL)
+    return -1;
+  if(op != EPOLL_CTL_DEL &&
+     copyin(myproc()->pagetable, (char*)&ev, uev, sizeof(ev)) < 0)
+    return -1;
+  return epollctl(epf->ep, op, fd, f, &ev);
+}
+
+uint64
+sys_epoll_wait(void)
+{
+  struct file *epf;
+  uint64 events; // user pointer to array of struct epoll_event
+  int max, timeout;
+
+  if(argfd(0, 0, &epf) < 0 || argaddr(1, &events) < 0 ||
+     argint(2, &max) < 0 || argint(3, &timeout) < 0)
+    return -1;
+  if(epf->type != FD_EPOLL)
+    return -1;
+  return epollwait(epf->ep, events, max, timeout);
+}
+
+// sendfile(out, in, offset, count): send count bytes of file in,
+// starting at offset, to socket out without copying them through
+// user space. A negative offset means in's own offset, which is
+// then advanced past the bytes sent.
+uint64
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int off, n, r;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 ||
+     argint(2, &off) < 0 || argint(3, &n) < 0)
+    return -1;
+  if(out->type != FD_SOCKET || in->type != FD_INODE || !in->readable || n < 0)
+    return -1;
+  if(n == 0)
+    return 0;
+  r = socket_sendfile(out, in->ip, off < 0 ? in->off : off, n);
+  if(off < 0 && r > 0)
+    in->off += r;
+  return r;
+}
+
+// fetch the iovec array of readv()/writev(): fd, iov, cnt.
+// Return the total length, or -1.
+static int
+argiov(struct file **pf, struct iovec *iov, int *pcnt)
+{
+  uint64 uiov; // user pointer to array of struct iovec
+  uint64 tot = 0;
+  int i, cnt;
+
+  if(argfd(0, 0, pf) < 0 || argaddr(1, &uiov) < 0 || argint(2, &cnt) < 0)
+    return -1;
+  if(cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)iov, uiov, cnt * sizeof(iov[0])) < 0)
+    return -1;
+  for(i = 0; i < cnt; i++){
+    tot += iov[i].iov_len;
+    if(iov[i].iov_len > 0x7fffffff || tot > 0x7fffffff)
+      return -1;
+  }
+  *pcnt = cnt;
+  return tot;
+}
+
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt, n;
+
+  if((n = argiov(&f, iov, &cnt)) < 0)
+    return -1;
+  if(n == 0)
+    return 0;
+  return filereadv(f, iov, cnt);
+}
+
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int cnt, n;
+
+  if((n = argiov(&f, iov, &cnt)) < 0)
+    return -1;
+  if(n == 0)
+    return 0;
+  return filewritev(f, iov, cnt);
+}
@@ -6,8 +6,19 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "socket.h"
 
-uint64 sys_socket(void) { return socket(); }
+uint64 sys_socket(void) {
+  int type;
+
+  if (argint(0, &type) < 0) {
+    return -1;
+  }
+  return socket(type);
+}
 
 uint64 sys_socket_connect() {
   int fd;
@@ -53,17 +64,20 @@ uint64 sys_socket_bind(void) {
 }
 
 uint64 sys_socket_listen(void) {
-  int fd;
+  int fd, backlog;
   struct file* f;
 
   if (argint(0, &fd) < 0) {
     panic("fail to get fd.");
   }
+  if (argint(1, &backlog) < 0) {
+    panic("fail to get backlog.");
+  }
   if (fd < 0 || fd >= NOFILE || (f = myproc()->ofile[fd]) == 0) {
     panic("incorrect fd.");
   }
 
-  return socket_listen(f);
+  return socket_listen(f, backlog);
 }
 
 uint64 sys_socket_accept(void) {
@@ -78,4 +92,71 @@ uint64 sys_socket_accept(void) {
   }
 
   return socket_accept(f);
-}
\ No newline at end of file
+}
+uint64 sys_socket_setcc(void) {
+  int fd;
+  char name[16];
+  struct file* f;
+
+  if (argint(0, &fd) < 0 || argstr(1, name, sizeof(name)) < 0) {
+    return -1;
+  }
+  if (fd < 0 || fd >= NOFILE || (f = myproc()->ofile[fd]) == 0) {
+    return -1;
+  }
+  return socket_setcc(f, name);
+}
+
+// fetch the arguments of sendmmsg()/recvmmsg(): fd, msgs, n.
+// Return the user address of the msgs, or 0.
+static uint64 argmmsg(struct file** pf, struct mmsghdr* msg, int* pn) {
+  int fd, n;
+  uint64 umsg;
+  struct file* f;
+
+  if (argint(0, &fd) < 0 || argaddr(1, &umsg) < 0 || argint(2, &n) < 0) {
+    return 0;
+  }
+  if (fd < 0 || fd >= NOFILE || (f = myproc()->ofile[fd]) == 0 ||
+      f->type != FD_DGRAM) {
+    return 0;
+  }
+  if (n <= 0 || n > MMSG_MAX) {
+    return 0;
+  }
+  if (copyin(myproc()->pagetable, (char*)msg, umsg, n * sizeof(msg[0])) < 0) {
+    return 0;
+  }
+  *pf = f;
+  *pn = n;
+  return umsg;
+}
+
+uint64 sys_sendmmsg(void) {
+  struct mmsghdr msg[MMSG_MAX];
+  struct file* f;
+  int n;
+
+  if (argmmsg(&f, msg, &n) == 0) {
+    return -1;
+  }
+  return socket_sendmmsg(f, msg, n);
+}
+
+uint64 sys_recvmmsg(void) {
+  struct mmsghdr msg[MMSG_MAX];
+  struct file* f;
+  uint64 umsg;
+  int n;
+
+  if ((umsg = argmmsg(&f, msg, &n)) == 0) {
+    return -1;
+  }
+  if ((n = socket_recvmmsg(f, msg, n)) <= 0) {
+    return -1;
+  }
+  if (copyout(myproc()->pagetable, umsg, (char*)msg, n * sizeof(msg[0])) < 0) {
+    return -1;
+  }
+  return n;
+}
@@ -191,6 +191,8 @@ devintr()
       uartintr();
     } else if(irq == VIRTIO0_IRQ){
       virtio_disk_intr();
+    } else if(irq == VIRTIO1_IRQ){
+      virtio_net_intr();
     } else {
       // the PLIC sends each device interrupt to every core,
       // which generates a lot of interrupts with irq==0.
@@ -206,6 +208,9 @@ devintr()
 
     if(cpuid() == 0){
       clockintr();
+      polltick();
+      // wake the network thread if an lwIP timer is due.
+      nettick();
     }
     
     // acknowledge the software interrupt by clearing
@@ -0,0 +1,7 @@
+// a buffer of readv()/writev()
+struct iovec {
+  void *iov_base;  // start of the buffer
+  uint64 iov_len;  // bytes in it
+};
+
+#define IOV_MAX  16  // most buffers in one readv()/writev()
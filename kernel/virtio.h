@@ -47,7 +47,14 @@
 #define VIRTIO_RING_F_EVENT_IDX     29
 
 // net device feature bits
+#define VIRTIO_NET_F_CSUM           0  /* Device checksums packets we send */
+#define VIRTIO_NET_F_GUEST_CSUM     1  /* Device validates checksums of received packets */
 #define VIRTIO_NET_F_MAC            5
+#define VIRTIO_NET_F_GUEST_TSO4     7  /* Device may send us TCPv4 packets beyond the MTU */
+#define VIRTIO_NET_F_HOST_TSO4      11 /* Device segments TCPv4 packets we send */
+#define VIRTIO_NET_F_MRG_RXBUF      15 /* Device may spread a packet over several rx buffers */
+#define VIRTIO_NET_F_CTRL_VQ        17 /* Control channel available */
+#define VIRTIO_NET_F_MQ             22 /* Device supports multiple queue pairs */
 
 // a single descriptor, from the spec.
 // a single block that contains data and is accessed by device 
@@ -80,6 +87,19 @@ struct virtq_used {
   uint16 idx;   // device increments when it adds a ring[] entry
   struct virtq_used_elem ring[];
 };
+#define VIRTQ_USED_F_NO_NOTIFY 1 // device needs no QUEUE_NOTIFY
+
+// with VIRTIO_RING_F_EVENT_IDX, each side publishes the ring index it
+// next wants to hear about, in the word following the other side's
+// ring: the driver wants an interrupt once used->idx passes used_event,
+// the device wants a notify once avail->idx passes avail_event.
+#define VIRTQ_USED_EVENT(avail, num) ((avail)->ring[num])
+#define VIRTQ_AVAIL_EVENT(used, num) (*(volatile uint16 *)&(used)->ring[num])
+
+// having moved an index from old to new, does the other side
+// want to hear about it, given its event index?
+#define VIRTQ_NEED_EVENT(event, new, old) \
+  ((uint16)((new) - (event) - 1) < (uint16)((new) - (old)))
 
 // these are specific to virtio block devices, e.g. disks,
 // described in Section 5.2 of the spec.
@@ -110,7 +130,8 @@ struct virtio_blk_req {
 #define VIRTIO_NET_HDR_GSO_TCPV6 4
 #define VIRTIO_NET_HDR_GSO_ECN 0x80
 
-// the format of the header of net package
+// the format of the header of net package.
+// num_buffers is only there if VIRTIO_NET_F_MRG_RXBUF was negotiated.
 struct virtio_net_hdr {
   uint8 flags;
   uint8 gso_type;
@@ -118,6 +139,40 @@ struct virtio_net_hdr {
   uint16 gso_size;
   uint16 csum_start;
   uint16 csum_offset;
-  //uint16 num_buffers;  // legacy interface
+  uint16 num_buffers;
+};
+
+// net device configuration space, at VIRTIO_MMIO_CONFIG.
+#define VIRTIO_NET_CONFIG_MAC       0  // 6 bytes
+#define VIRTIO_NET_CONFIG_MAX_PAIRS 8  // uint16 max_virtqueue_pairs, with MQ
+
+// a command on the net control queue: this header, then the
+// command's data, then one byte the device writes its answer to.
+struct virtio_net_ctrl_hdr {
+  uint8 class;
+  uint8 cmd;
+};
+#define VIRTIO_NET_CTRL_MQ              4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0 // data: uint16 number of pairs
+#define VIRTIO_NET_OK  0
+#define VIRTIO_NET_ERR 1
+
+// most rx buffers the net driver ever puts on one ring.
+#define VIRTIO_NET_RX_MAX 128
+
+// a batch of received packets, filled in by virtio_net_recv().
+// packet i comes with header hdr[i] and is made of the next n[i]
+// pieces of data[]/len[], which stay in ring buffers slot[] until
+// given back with virtio_net_recv_done(). slot numbers also name
+// the queue the buffer belongs to.
+struct virtio_net_rxbatch {
+  int npkt;
+  struct virtio_net_hdr hdr[VIRTIO_NET_RX_MAX];
+  int n[VIRTIO_NET_RX_MAX];
+
+  int npiece;
+  void *data[VIRTIO_NET_RX_MAX];
+  int len[VIRTIO_NET_RX_MAX];
+  int slot[VIRTIO_NET_RX_MAX];
 };
 
@@ -43,7 +43,8 @@ struct disk {
 
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
-  uint16 used_idx; // used_idx = used->idx -1, its value corresponding to the index of operation that currently finished.
+  uint16 used_idx; // next used ring entry to look at. free-running, ring[used_idx % NUM].
+  int event_idx;   // VIRTIO_RING_F_EVENT_IDX negotiated?
 
   // track info about each in-flight operations,
   // for use when completion interrupt arrives.
@@ -106,9 +107,9 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
   features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  disk.event_idx = (features & (1 << VIRTIO_RING_F_EVENT_IDX)) != 0;
 
   // Tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -275,7 +276,12 @@ virtio_disk_rw(struct buf *b, int write)
   __sync_synchronize();
   disk.avail->idx += 1;
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  // with EVENT_IDX, the device tells us whether it is still busy
+  // with earlier requests and will find this one by itself.
+  __sync_synchronize();
+  if(!disk.event_idx ||
+     VIRTQ_NEED_EVENT(VIRTQ_AVAIL_EVENT(disk.used, NUM), disk.avail->idx, disk.avail->idx - 1))
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
@@ -295,18 +301,27 @@ virtio_disk_intr(void)
 
   // Device will put the finished operation into used ring.
   // We need to handle latest finished operation.
-  while((disk.used_idx % NUM) != (disk.used->idx % NUM)){
-    int id = disk.used->ring[disk.used_idx].id;
+  // With EVENT_IDX, ask for the next interrupt only once all of
+  // them are handled, so a burst of completions raises just one;
+  // then look again for any that slipped in before the device saw that.
+  do {
+    while(disk.used_idx != disk.used->idx){
+      int id = disk.used->ring[disk.used_idx % NUM].id;
 
-    // I/O operation is not successful
-    if(disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
-    
-    disk.info[id].b->disk = 0;   // disk is done with buf
-    wakeup(disk.info[id].b);
+      // I/O operation is not successful
+      if(disk.info[id].status != 0)
+        panic("virtio_disk_intr status");
 
-    disk.used_idx = (disk.used_idx + 1) % NUM;
-  }
+      disk.info[id].b->disk = 0;   // disk is done with buf
+      wakeup(disk.info[id].b);
+
+      disk.used_idx += 1;
+    }
+    if(!disk.event_idx)
+      break;
+    VIRTQ_USED_EVENT(disk.avail, NUM) = disk.used_idx;
+    __sync_synchronize();
+  } while(disk.used_idx != disk.used->idx);
   *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   release(&disk.vdisk_lock);
@@ -12,152 +12,353 @@
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO1 + (r)))
 
-// 8 descriptors for net IO operation.
-#define NUM 8
-#define READ 0
-#define SEND 1
-
-struct info {
-  struct buf *b;
-  char status;
-};
-
+// upper bound on descriptors per queue. the ring actually used is the
+// largest power of two no bigger than this and the device's QUEUE_NUM_MAX.
+// 256 descriptors keep the descriptor table inside one page.
+#define NUM_MAX 256
+
+// device queue numbers of queue pair i, and of the control queue
+// of a device with max_pairs queue pairs.
+#define READ(i) (2*(i))
+#define SEND(i) (2*(i)+1)
+#define CTRL(max_pairs) (2*(max_pairs))
+
+// slot numbers handed out by virtio_net_recv() say which rx queue
+// the buffer is from.
+#define SLOT(qid, k) ((qid) * VIRTIO_NET_RX_MAX + (k))
+#define SLOT_QUEUE(slot) ((slot) / VIRTIO_NET_RX_MAX)
+#define SLOT_INDEX(slot) ((slot) % VIRTIO_NET_RX_MAX)
+
+// a receive buffer. the device writes the virtio net header right in
+// front of data, so the two descriptors of a slot cover one contiguous
+// run of memory: with mergeable rx buffers a packet continued from the
+// previous buffer starts where the header would be.
 struct eth_buffer {
+  struct virtio_net_hdr hdr;
   char data[1514];
 };
 
-struct net {
+// the rings shared with the device.
+struct virtq {
   struct virtq_desc *desc;
   struct virtq_avail *avail;
   struct virtq_used *used;
 
-  char free[NUM];   // keep trach of free status of each descriptor
-  uint16 used_idx;  // previous index in used ring[]
+  int qnum;         // queue number on the device
+  int num;          // ring size, chosen in initialize_queue()
+  uint16 used_idx;  // next used ring entry to look at, free-running
+};
+
+// receive queue. descriptors are handed out in slots of two: slot k
+// owns desc[2k] for the virtio net header and desc[2k+1] for the
+// packet, both pointing into pbuf[k]. a slot is either on the ring,
+// lent out by virtio_net_recv(), or waiting on refill[] to go back
+// on the ring with the next batch.
+struct rxq {
+  struct spinlock lock;
+  struct virtq q;
+  int nlent;                      // slots lent out by virtio_net_recv()
+  uint16 refill[VIRTIO_NET_RX_MAX]; // stack of slots to put back
+  int nrefill;                    // number of slots on refill[]
+  uint64 drops;                   // packets too big for a batch
+
+  // ethernet packet buffers, written by the device. a few per page.
+  struct eth_buffer *pbuf[VIRTIO_NET_RX_MAX];
+};
+
+// transmit queue. a frame is a chain of one header descriptor followed
+// by one descriptor per piece of the frame. free descriptors are kept
+// on a stack. ops[] and cookie[] are indexed by the chain's head.
+struct txq {
+  struct spinlock lock;
+  struct virtq q;
+  uint16 free[NUM_MAX];     // stack of free descriptors
+  int nfree;                // number of descriptors on free[]
 
   // net command headers.
-  // one-for-one with descriptors, for convenience.
-  // worked as a temp variable for each descriptor.
-  // here will be used to save header for each operation.
-  struct virtio_net_hdr ops[NUM/2];
-  // ethernet packet buffers
-  struct eth_buffer pbuf[NUM/2];
-} net_send, net_recv;
+  struct virtio_net_hdr ops[NUM_MAX];
+  // passed to netsent() once the device is done with the chain.
+  void *cookie[NUM_MAX];
+};
 
-struct spinlock vnettx_lock, vnetrx_lock;
+// one receive and one transmit queue per hart, if the device has
+// that many (VIRTIO_NET_F_MQ); otherwise just pair 0. pair i is
+// only touched under its own locks, so harts working on different
+// pairs do not contend.
+static struct rxq net_recv[NCPU];
+static struct txq net_send[NCPU];
+static int npairs;
+
+// the control queue, used once to turn on the other queue pairs.
+static struct virtq net_ctrl;
+static struct {
+  struct virtio_net_ctrl_hdr hdr;
+  uint16 pairs;
+  uint8 ack;
+} ctrl_cmd;
+
+// size of the virtio net header in front of every packet; it has
+// num_buffers only with VIRTIO_NET_F_MRG_RXBUF.
+static int hdrlen;
+// does the device merge rx buffers?
+static int mrg_rxbuf;
+// were notifications negotiated with VIRTIO_RING_F_EVENT_IDX?
+static int event_idx;
 
 
 /*------------------------ HELPER FUNCTION --------------------------*/
-// find a free descriptor, mark it non-free, return its index.
-static int alloc_desc(int send) {
-  struct net *net = send == 1 ? &net_send : &net_recv;
-  for (int i = 0; i < NUM; i++) {
-    if (net->free[i]) {
-      net->free[i] = 0;
-      return i;
-    }
-  }
-  return -1;
+// pop a free tx descriptor off the stack. caller checks nfree first.
+static int alloc_desc(struct txq *tx) {
+  if (tx->nfree == 0) panic("virtio_net 3");
+  return tx->free[--tx->nfree];
 }
 
-// mark a descriptor as free.
-static void free_desc(int i, int send) {
-  struct net *net = send == 1 ? &net_send : &net_recv;
-  if (i >= NUM) panic("virtio_net 1");
-  if (net->free[i]) panic("virtio_net 2");
-  net->desc[i].addr = 0;
-  net->free[i] = 1;
-  wakeup(&net->free[0]);
+// push a tx descriptor back on the free stack.
+static void free_desc(struct txq *tx, int i) {
+  if (i < 0 || i >= tx->q.num) panic("virtio_net 4");
+  if (tx->nfree >= tx->q.num) panic("virtio_net 5");
+  tx->q.desc[i].addr = 0;
+  tx->free[tx->nfree++] = i;
 }
 
-// free a chain of descriptors.
-static void free_chain(int i, int send) {
-  struct net *net = send == 1 ? &net_send : &net_recv;
-  while (1) {
-    free_desc(i, send);
-    if (net->desc[i].flags & VIRTQ_DESC_F_NEXT)
-      i = net->desc[i].next;
-    else
-      break;
-  }
+// does the used ring hold entries we have not looked at yet?
+static int used_pending(struct virtq *q) {
+  return q->used_idx != q->used->idx;
 }
 
-static int alloc2_desc(int *idx, int send) {
-  for (int i = 0; i < 2; i++) {
-    idx[i] = alloc_desc(send);
-    if (idx[i] < 0) {
-      for (int j = 0; j < i; j++)
-        free_desc(idx[j], send);  // free those already allocated descriptors
-      return -1;
-    }
-  }
-  //printf("alloc %s desc: %d,%d\n",send?"Tx":"Rx",idx[0],idx[1]);
-  return 0;
+// how many used ring entries we have not looked at yet.
+static int used_count(struct virtq *q) {
+  return (uint16)(q->used->idx - q->used_idx);
 }
 
-void initialize_queue(int queue_num) {
-  struct net *net = queue_num == SEND ? &net_send : &net_recv;
+// the avail ring of q went from index old to avail->idx. notify the
+// device unless it said it does not need to hear about that.
+static void notify(struct virtq *q, uint16 old) {
+  // publish avail->idx before looking at what the device wants.
+  __sync_synchronize();
+  if (event_idx ? VIRTQ_NEED_EVENT(VIRTQ_AVAIL_EVENT(q->used, q->num),
+                                   q->avail->idx, old)
+                : !(q->used->flags & VIRTQ_USED_F_NO_NOTIFY))
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = q->qnum;  // value is queue number
+}
 
+// ask for an interrupt once the device has used n more entries
+// of q; none at all if n is 0 or someone polls us. without
+// EVENT_IDX this can only turn interrupts on or off.
+static void want_intr(struct virtq *q, int n) {
+  if (event_idx)
+    VIRTQ_USED_EVENT(q->avail, q->num) =
+      (netpoll || n == 0) ? q->used_idx - 1 : q->used_idx + n - 1;
+  else
+    q->avail->flags = (netpoll || n == 0) ? VIRTQ_AVAIL_F_NO_INTERRUPT : 0;
+  __sync_synchronize();
+}
+
+// allocate the rings of q.
+static void alloc_queue(struct virtq *q) {
+  q->desc = kalloc();
+  q->avail = kalloc();
+  q->used = kalloc();
+  if (!q->desc || !q->avail || !q->used)
+    panic("virtio net kalloc fail");
+  memset(q->desc, 0, PGSIZE);
+  memset(q->avail, 0, PGSIZE);
+  memset(q->used, 0, PGSIZE);
+}
+
+void initialize_queue(int queue_num, struct virtq *q) {
   *R(VIRTIO_MMIO_QUEUE_SEL) = queue_num;
-  if (*R(VIRTIO_MMIO_QUEUE_READY))  // avoid reseting queue repeatly
-    panic("virtio disk ready not zero");
+  if (*R(VIRTIO_MMIO_QUEUE_READY)) {  // avoid reseting queue repeatly
+    printf("virtio net: queue %d already set up\n", queue_num);
+    panic("virtio net queue ready not zero");
+  }
   uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
   if (max == 0) panic("virtio net does not have this queue");
-  if (max < NUM) panic("virtio net max queue too short");
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  if (max < 2) panic("virtio net max queue too short");
+  q->qnum = queue_num;
+  q->num = 2;
+  while (q->num * 2 <= max && q->num * 2 <= NUM_MAX)
+    q->num *= 2;
+  if (q->num/2 > VIRTIO_NET_RX_MAX) panic("virtio net rx ring");
+  *R(VIRTIO_MMIO_QUEUE_NUM) = q->num;
 
   // point out the address to device. Specify high address and low address
   // separately. Disk will read/SEND these regions.
-  *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)net->desc;
-  *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)net->desc >> 32;
-  *R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)net->avail;
-  *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)net->avail >> 32;
-  *R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)net->used;
-  *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)net->used >> 32;
+  *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)q->desc;
+  *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)q->desc >> 32;
+  *R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)q->avail;
+  *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)q->avail >> 32;
+  *R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)q->used;
+  *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)q->used >> 32;
 
   /* Queue ready. Initialization finished*/
   *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
 }
 
-// place an empty recv block(2 descriptors) into virtio_recv queue
-void place_recv_block() {
-  int idx[2];
-  while (1) {
-    if (alloc2_desc(idx, READ) == 0) {
-      break;
-    }
-    sleep(&net_recv.free[0], &vnetrx_lock);
-  }
-
-  // set the header for this operation
-  struct virtio_net_hdr *buf0 = &net_recv.ops[idx[0]/2];
-  buf0->flags = 0;
-  buf0->gso_type = VIRTIO_NET_HDR_GSO_NONE;
+// hand the empty buffer of slot k back to the device through
+// rx's queue, without notifying it. caller must hold rx->lock.
+static void post_recv_slot(struct rxq *rx, int k) {
+  struct virtq *q = &rx->q;
+  struct eth_buffer *b = rx->pbuf[k];
+  int d0 = 2*k, d1 = 2*k+1;
 
-  // set the first descriptor(header)
-  net_recv.desc[idx[0]].addr = (uint64)buf0;
-  net_recv.desc[idx[0]].len = sizeof(struct virtio_net_hdr);
-  net_recv.desc[idx[0]].flags = VIRTQ_DESC_F_WRITE;
-  net_recv.desc[idx[0]].flags |= VIRTQ_DESC_F_NEXT;
-  net_recv.desc[idx[0]].next = idx[1];
+  // set the first descriptor(header), ending where data begins
+  q->desc[d0].addr = (uint64)(b->data - hdrlen);
+  q->desc[d0].len = hdrlen;
+  q->desc[d0].flags = VIRTQ_DESC_F_WRITE;
+  q->desc[d0].flags |= VIRTQ_DESC_F_NEXT;
+  q->desc[d0].next = d1;
 
   // set the secode descriptor(data)
-  net_recv.desc[idx[1]].addr = (uint64)&(net_recv.pbuf[idx[0]/2].data);
-  net_recv.desc[idx[1]].len = PGSIZE;
-  net_recv.desc[idx[1]].flags = VIRTQ_DESC_F_WRITE;  // device SENDs b->data
-  net_recv.desc[idx[1]].next = 0;
+  q->desc[d1].addr = (uint64)b->data;
+  q->desc[d1].len = sizeof(b->data);
+  q->desc[d1].flags = VIRTQ_DESC_F_WRITE;  // device writes pbuf
+  q->desc[d1].next = 0;
 
   // avail->idx tells the device how far to look in avail->ring.
   // avail->ring[...] are desc[] indices the device should process.
   // we only tell device the first index in our chain of descriptors.
   // add this new running operation to avail ring[]
-  net_recv.avail->ring[net_recv.avail->idx % NUM] = idx[0];
-  net_recv.avail->flags = 1;
+  q->avail->ring[q->avail->idx % q->num] = d0;
   __sync_synchronize();
-  net_recv.avail->idx += 1;
+  q->avail->idx += 1;
+}
+
+// put every slot waiting on rx->refill[] back on the recv queue,
+// with a single notify. caller must hold rx->lock.
+static void refill(struct rxq *rx) {
+  struct virtq *q = &rx->q;
+  uint16 old = q->avail->idx;
+
+  if (rx->nrefill == 0)
+    return;
+  while (rx->nrefill > 0)
+    post_recv_slot(rx, rx->refill[--rx->nrefill]);
+  notify(q, old);
+}
+
+// set up rx queue qid with a full ring of empty buffers.
+static void init_recv(int qid) {
+  struct rxq *rx = &net_recv[qid];
+  char *page = 0;
+  int per_page = PGSIZE / sizeof(struct eth_buffer);
+
+  initlock(&rx->lock, "virtio_net Rx");
+  initialize_queue(READ(qid), &rx->q);
+  for (int k = 0; k < rx->q.num/2; k++) {
+    if (k % per_page == 0 && (page = kalloc()) == 0)
+      panic("virtio net kalloc fail");
+    rx->pbuf[k] = (struct eth_buffer *)page + k % per_page;
+  }
 
-  if (net_recv.used->flags == 0) {
-    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = READ;  // value is queue number
+  acquire(&rx->lock);
+  for (int k = rx->q.num/2 - 1; k >= 0; k--) {
+    rx->refill[rx->nrefill++] = k;
   }
+  refill(rx);
+  release(&rx->lock);
+}
+
+// set up tx queue qid.
+static void init_send(int qid) {
+  struct txq *tx = &net_send[qid];
+
+  initlock(&tx->lock, "virtio_net Tx");
+  initialize_queue(SEND(qid), &tx->q);
+
+  // all descriptors start out unused.
+  tx->nfree = 0;
+  for (int i = tx->q.num - 1; i >= 0; i--)
+    tx->free[tx->nfree++] = i;
+}
+
+// ask the device to use n queue pairs, through the control queue.
+// only done during virtio_net_init(), so just spin for the answer.
+static int set_queue_pairs(int n) {
+  struct virtq *q = &net_ctrl;
+  uint16 old = q->avail->idx;
+
+  ctrl_cmd.hdr.class = VIRTIO_NET_CTRL_MQ;
+  ctrl_cmd.hdr.cmd = VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET;
+  ctrl_cmd.pairs = n;
+  ctrl_cmd.ack = VIRTIO_NET_ERR;
+
+  q->desc[0].addr = (uint64)&ctrl_cmd.hdr;
+  q->desc[0].len = sizeof(ctrl_cmd.hdr);
+  q->desc[0].flags = VIRTQ_DESC_F_NEXT;
+  q->desc[0].next = 1;
+  q->desc[1].addr = (uint64)&ctrl_cmd.pairs;
+  q->desc[1].len = sizeof(ctrl_cmd.pairs);
+  q->desc[1].flags = VIRTQ_DESC_F_NEXT;
+  q->desc[1].next = 2;
+  q->desc[2].addr = (uint64)&ctrl_cmd.ack;
+  q->desc[2].len = sizeof(ctrl_cmd.ack);
+  q->desc[2].flags = VIRTQ_DESC_F_WRITE;  // device writes the answer
+  q->desc[2].next = 0;
+
+  want_intr(q, 0);
+  q->avail->ring[q->avail->idx % q->num] = 0;
+  __sync_synchronize();
+  q->avail->idx += 1;
+  notify(q, old);
+
+  while (!used_pending(q))
+    ;
+  q->used_idx++;
+  __sync_synchronize();
+  return ctrl_cmd.ack == VIRTIO_NET_OK ? 0 : -1;
+}
+
+// Take one finished send off tx's used ring and free its descriptors.
+// Return the cookie it was sent with, or 0 if the device has not
+// finished anything.
+static void *reclaim_one(struct txq *tx) {
+  struct virtq *q = &tx->q;
+  void *cookie = 0;
+
+  acquire(&tx->lock);
+  if (used_pending(q)) {
+    int i = q->used->ring[q->used_idx % q->num].id;
+    q->used_idx++;
+
+    cookie = tx->cookie[i];
+    tx->cookie[i] = 0;
+    while (1) {
+      int flags = q->desc[i].flags;
+      int next = q->desc[i].next;
+      free_desc(tx, i);
+      if (!(flags & VIRTQ_DESC_F_NEXT))
+        break;
+      i = next;
+    }
+  }
+  release(&tx->lock);
+  return cookie;
+}
+
+// ask for a tx interrupt once 3/4 of the sends in flight are done
+// rather than for every one of them. caller holds tx->lock.
+static void want_send_intr(struct txq *tx) {
+  struct virtq *q = &tx->q;
+  int inflight = (uint16)(q->avail->idx - q->used_idx);
+  want_intr(q, inflight - inflight/4);
+}
+
+// Give every finished send of tx back to the network stack. netsent()
+// is called without tx->lock held, since it frees pbufs.
+static void reclaim_send(struct txq *tx) {
+  void *cookie;
+  int again;
+
+  do {
+    while ((cookie = reclaim_one(tx)) != 0)
+      netsent(cookie);
+    acquire(&tx->lock);
+    want_send_intr(tx);
+    // catch sends that finished before the device saw the new event.
+    again = used_pending(&tx->q);
+    release(&tx->lock);
+  } while (again);
 }
 
 void print_packet(const char *data, int len, int send){
@@ -169,27 +370,14 @@ void print_packet(const char *data, int len, int send){
 }
 
 /*------------------------ DRIVER --------------------------*/
-// initialize the NIC and store the MAC address 
-void virtio_net_init(void *mac) {
+// initialize the NIC and store the MAC address. *nqueues is set to
+// the number of queue pairs to spread traffic over.
+// return the feature bits agreed on with the device.
+uint64 virtio_net_init(void *mac, int *nqueues) {
   printf("virtio_net_init begin.\n");
 
-  initlock(&vnettx_lock, "virtio_net Tx");
-  initlock(&vnetrx_lock, "virtio_net Rx");
-
   uint32 status = 0;
-
-  for (int i = 0; i < 2; i++) {
-    struct net *net = i == SEND ? &net_send : &net_recv;
-
-    net->desc = kalloc();
-    net->avail = kalloc();
-    net->used = kalloc();
-    if (!net->desc || !net->avail || !net->used)
-      panic("virtio net kalloc fail");
-    memset(net->desc, 0, PGSIZE);
-    memset(net->avail, 0, PGSIZE);
-    memset(net->used, 0, PGSIZE);
-  }
+  int max_pairs = 1;
 
   if (*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
       *R(VIRTIO_MMIO_VERSION) != 2 || *R(VIRTIO_MMIO_DEVICE_ID) != 1 ||
@@ -208,11 +396,33 @@ void virtio_net_init(void *mac) {
   status |= VIRTIO_CONFIG_S_DRIVER;
   *R(VIRTIO_MMIO_STATUS) = status;
 
-  // Negotiate features.
+  // Negotiate features. take checksum and segmentation offload
+  // if the device has it; TSO needs the device to checksum too.
+  // large packets from the device must be spread over mergeable
+  // rx buffers, ours are too small to hold one. multiple queue
+  // pairs are switched on through the control queue.
   uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
-  features &= (1 << VIRTIO_NET_F_MAC);
+  features &= (1 << VIRTIO_NET_F_MAC) | (1 << VIRTIO_NET_F_CSUM) |
+              (1 << VIRTIO_NET_F_GUEST_CSUM) | (1 << VIRTIO_NET_F_HOST_TSO4) |
+              (1 << VIRTIO_NET_F_GUEST_TSO4) | (1 << VIRTIO_NET_F_MRG_RXBUF) |
+              (1 << VIRTIO_NET_F_CTRL_VQ) | (1 << VIRTIO_NET_F_MQ) |
+              (1 << VIRTIO_RING_F_EVENT_IDX);
+  if (!(features & (1 << VIRTIO_NET_F_CSUM)))
+    features &= ~(1 << VIRTIO_NET_F_HOST_TSO4);
+  if (!(features & (1 << VIRTIO_NET_F_GUEST_CSUM)) ||
+      !(features & (1 << VIRTIO_NET_F_MRG_RXBUF)))
+    features &= ~(1 << VIRTIO_NET_F_GUEST_TSO4);
+  if (!(features & (1 << VIRTIO_NET_F_CTRL_VQ)) ||
+      !(features & (1 << VIRTIO_NET_F_MQ)))
+    features &= ~((1 << VIRTIO_NET_F_CTRL_VQ) | (1 << VIRTIO_NET_F_MQ));
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
 
+  mrg_rxbuf = (features & (1 << VIRTIO_NET_F_MRG_RXBUF)) != 0;
+  event_idx = (features & (1 << VIRTIO_RING_F_EVENT_IDX)) != 0;
+  hdrlen = sizeof(struct virtio_net_hdr);
+  if (!mrg_rxbuf)
+    hdrlen -= sizeof(uint16);  // no num_buffers
+
   // Tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
   *R(VIRTIO_MMIO_STATUS) = status;
@@ -222,141 +432,242 @@ void virtio_net_init(void *mac) {
   if (!(status & VIRTIO_CONFIG_S_FEATURES_OK))
     panic("virtio net FEATURES_OK unset");
 
-  printf("initialize virtio queue.\n");
-  initialize_queue(READ);  // receive queue
-  initialize_queue(SEND);  // transmit queue
+  // one queue pair per hart, as far as the device goes.
+  if (features & (1 << VIRTIO_NET_F_MQ))
+    max_pairs = *R(VIRTIO_MMIO_CONFIG + VIRTIO_NET_CONFIG_MAX_PAIRS) & 0xffff;
+  npairs = max_pairs < NCPU ? max_pairs : NCPU;
+  if (npairs < 1)
+    npairs = 1;
 
-  // all NUM descriptors start out unused.
-  for (int i = 0; i < NUM; i++) {
-    net_send.free[i] = 1;
-    net_recv.free[i] = 1;
+  printf("initialize virtio queue.\n");
+  for (int i = 0; i < npairs; i++) {
+    alloc_queue(&net_recv[i].q);
+    alloc_queue(&net_send[i].q);
+    init_recv(i);  // receive queue
+    init_send(i);  // transmit queue
+  }
+  if (features & (1 << VIRTIO_NET_F_MQ)) {
+    alloc_queue(&net_ctrl);
+    initialize_queue(CTRL(max_pairs), &net_ctrl);
   }
 
   // Tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
   *R(VIRTIO_MMIO_STATUS) = status;
 
+  // the device starts out with one queue pair.
+  if (npairs > 1 && set_queue_pairs(npairs) < 0) {
+    printf("virtio_net_init: device refused %d queue pairs\n", npairs);
+    npairs = 1;
+  }
+  *nqueues = npairs;
+
   // pass out mac address(48bits)
   uint8 mac_ad[6] = {0};
   for (int i = 0; i < 6; i++) {
-    mac_ad[i] = (uint8)*R(VIRTIO_MMIO_CONFIG + i * sizeof(uint8));
+    mac_ad[i] = (uint8)*R(VIRTIO_MMIO_CONFIG + VIRTIO_NET_CONFIG_MAC + i * sizeof(uint8));
   }
   memmove(mac, mac_ad, 6);
 
-  // Add initial block to recv queue
-  //void *buf = (char*)&(net_send.pbuf[0].data);
-  for (int i = 0; i < NUM/2; i++) {
-    place_recv_block();
-  }
-
-  printf("virtio_net_init finished.\n");
+  printf("virtio_net_init finished. %d queue pairs, rx ring %d, tx ring %d%s%s\n",
+         npairs, net_recv[0].q.num, net_send[0].q.num,
+         mrg_rxbuf ? ", mergeable rx" : "", event_idx ? ", event idx" : "");
+  return features;
 }
 
-// Send data. Free previous completed descriptors,
-// and allocate new descriptors for current operation.
-// Place the descriptor into queue, notify the device,
-// and then exit immediately.
-int virtio_net_send(const void *data, int len) {
-  acquire(&vnettx_lock);
-
-  // free the descriptors of send op that just complete.
-  while ((net_send.used_idx % NUM) != (net_send.used->idx % NUM)) {
-    int id = net_send.used->ring[net_send.used_idx].id;
-    //int packet_id = net_send.desc[id].next;
-
-    // update use index
-    //kfree((void *)net_send.desc[packet_id].addr);
-
-    // free the used descriptor
-    net_send.used_idx = (net_send.used_idx + 1) % NUM;
-    free_chain(id, SEND);
-  }
-
-  // two blocks: first for virtio net header; second the for packet
-  int idx[2];
-  if (alloc2_desc(idx, SEND)) {
-    // device is busy
-    release(&vnettx_lock);
+// Send one frame made of n pieces on tx queue qid without copying it.
+// data[i] and len[i] describe the pieces, which must stay put until the
+// device is done with them; at that point cookie (non-zero) is passed
+// to netsent(). hdr, if not 0, asks the device for offloads such as
+// checksumming. Place the chain into queue, notify the device, and
+// then exit immediately. Return -1 if the queue has too few free
+// descriptors.
+int virtio_net_sendv(int qid, struct virtio_net_hdr *hdr, void **data,
+                     int *len, int n, void *cookie) {
+  struct txq *tx = &net_send[qid];
+  struct virtq *q = &tx->q;
+
+  // free the descriptors of send ops that just complete.
+  reclaim_send(tx);
+
+  acquire(&tx->lock);
+
+  // one descriptor for virtio net header, then one per piece
+  if (n + 1 > tx->nfree) {
+    release(&tx->lock);
     return -1;
   }
-
-  // populate the two descriptors.
-  struct virtio_net_hdr *buf0 = &net_send.ops[idx[0]/2];
+  int head = alloc_desc(tx);
 
   // set the header for this operation
-  buf0->flags = 0;
-  buf0->gso_type = VIRTIO_NET_HDR_GSO_NONE;
-
-  // set the first descriptor(header)
-  net_send.desc[idx[0]].addr = (uint64)buf0;
-  net_send.desc[idx[0]].len = sizeof(struct virtio_net_hdr);
-  net_send.desc[idx[0]].flags = VIRTQ_DESC_F_NEXT;
-  net_send.desc[idx[0]].next = idx[1];
-
-  char *packet_buffer = (char*)&(net_send.pbuf[idx[0]/2].data);
-  memmove(packet_buffer, data, len);
+  struct virtio_net_hdr *buf0 = &tx->ops[head];
+  if (hdr) {
+    *buf0 = *hdr;
+  } else {
+    memset(buf0, 0, sizeof(*buf0));
+    buf0->gso_type = VIRTIO_NET_HDR_GSO_NONE;
+  }
 
-  // set the second descriptor(data)
-  net_send.desc[idx[1]].addr = (uint64)packet_buffer;
-  net_send.desc[idx[1]].len = len;
-  net_send.desc[idx[1]].flags = 0;  // device read b->data
-  net_send.desc[idx[1]].next = 0;
+  q->desc[head].addr = (uint64)buf0;
+  q->desc[head].len = hdrlen;
+  q->desc[head].flags = 0;
+  q->desc[head].next = 0;
+
+  int prev = head;
+  for (int i = 0; i < n; i++) {
+    int d = alloc_desc(tx);
+    q->desc[d].addr = (uint64)data[i];
+    q->desc[d].len = len[i];
+    q->desc[d].flags = 0;  // device reads the piece
+    q->desc[d].next = 0;
+    q->desc[prev].flags |= VIRTQ_DESC_F_NEXT;
+    q->desc[prev].next = d;
+    prev = d;
+  }
+  tx->cookie[head] = cookie;
 
   // avail->idx tells the device how far to look in avail->ring.
   // avail->ring[...] are desc[] indices the device should process.
   // we only tell device the first index in our chain of descriptors.
   // add this new running operation to avail ring[]
-  net_send.avail->ring[net_send.avail->idx % NUM] = idx[0];
-  net_send.avail->flags = 1;
+  q->avail->ring[q->avail->idx % q->num] = head;
   __sync_synchronize();
-  net_send.avail->idx += 1;
+  q->avail->idx += 1;
 
   // put descriptors into queue, notify
-  if (net_send.used->flags == 0) {
-    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = SEND;  // value is queue number
-  }
+  want_send_intr(tx);
+  notify(q, q->avail->idx - 1);
 
-  release(&vnettx_lock);
-  //print_packet(data,len,1);
+  release(&tx->lock);
   return 0;
 }
 
-// Receive data. This function will first whether there is completed read block. 
-// If so, it will load one read operation into buffer and return the number of
-// bytes that it read. Then, it will generata a new empty recv block and place it into 
-// recv virtio queue. If there is no completed read block, return 0 immediately.
-int virtio_net_recv(void *data, int len) {
-  acquire(&vnetrx_lock);
-
-  // free the descriptors of read op that just complete.
-  if ((net_recv.used_idx % NUM) != (net_recv.used->idx % NUM)) {
-    int id = net_recv.used->ring[net_recv.used_idx].id;
-    int packet_id = net_recv.desc[id].next;
-
-    // copyout data from descriptor
-    int packet_buf_len = net_recv.used->ring[net_recv.used_idx].len-sizeof(struct virtio_net_hdr);
-    int recv_len = packet_buf_len > len ? len : packet_buf_len;
-    if (recv_len > 1514) {
-      panic("packet is too large. Data loss!");
+// Take up to budget received packets off rx queue qid in one go,
+// without copying them, after putting the buffers given back since
+// the last call on the ring again. With mergeable rx buffers a packet
+// may span several ring buffers. All of them stay off the recv queue
+// until virtio_net_recv_done(). Return the number of packets in *b.
+int virtio_net_recv(int qid, struct virtio_net_rxbatch *b, int budget) {
+  struct rxq *rx = &net_recv[qid];
+  struct virtq *q = &rx->q;
+  acquire(&rx->lock);
+
+  refill(rx);
+
+  b->npkt = b->npiece = 0;
+  while (b->npkt < budget && used_pending(q)) {
+    struct virtio_net_hdr *hdr = &b->hdr[b->npkt];
+    struct eth_buffer *buf = rx->pbuf[q->used->ring[q->used_idx % q->num].id/2];
+    int n = 1;
+
+    memset(hdr, 0, sizeof(*hdr));
+    memmove(hdr, buf->data - hdrlen, hdrlen);
+    if (mrg_rxbuf && hdr->num_buffers > 1)
+      n = hdr->num_buffers;
+    // the device publishes all buffers of a packet at once.
+    if (n > used_count(q))
+      break;
+
+    if (n > VIRTIO_NET_RX_MAX) {
+      // no batch can hold it: give its buffers back.
+      for (int i = 0; i < n; i++) {
+        struct virtq_used_elem *e = &q->used->ring[q->used_idx % q->num];
+        q->used_idx++;
+        rx->refill[rx->nrefill++] = e->id/2;
+      }
+      rx->drops++;
+      continue;
+    }
+    // no room left in this batch; it waits for the next.
+    if (b->npiece + n > VIRTIO_NET_RX_MAX)
+      break;
+
+    for (int i = 0; i < n; i++) {
+      struct virtq_used_elem *e = &q->used->ring[q->used_idx % q->num];
+      int k = b->npiece + i;
+      q->used_idx++;
+      buf = rx->pbuf[e->id/2];
+      b->slot[k] = SLOT(qid, e->id/2);
+      if (i == 0) {
+        b->data[k] = buf->data;
+        b->len[k] = e->len - hdrlen;
+      } else {
+        b->data[k] = buf->data - hdrlen;
+        b->len[k] = e->len;
+      }
     }
-    memmove(data, (void *)net_recv.desc[packet_id].addr, recv_len);
-
-    // free the used descriptor
-    net_recv.used_idx = (net_recv.used_idx + 1) % NUM;
-    free_chain(id, READ);
-
-    // Insert a new descriptor into the queue
-    //uint64 recv_buf = net_recv.desc[packet_id].addr;
-    place_recv_block();
-
-    release(&vnetrx_lock);
-    //print_packet(data,recv_len,0);
-    return recv_len;
-  } else {  // nothing done, return immediately
-    release(&vnetrx_lock);
-    return 0;
+
+    b->n[b->npkt++] = n;
+    b->npiece += n;
   }
+  rx->nlent += b->npiece;
+  refill(rx);
+
+  release(&rx->lock);
+  return b->npkt;
 }
 
+// Turn interrupts of rx queue qid on or off. Return nonzero if
+// packets are waiting already, which an interrupt turned on now
+// may miss.
+int virtio_net_recv_intr(int qid, int on) {
+  struct rxq *rx = &net_recv[qid];
+  int pending;
+
+  acquire(&rx->lock);
+  want_intr(&rx->q, on ? 1 : 0);
+  pending = used_pending(&rx->q);
+  release(&rx->lock);
+  return pending;
+}
 
+// Are so many buffers of rx queue qid lent out that the device is
+// left with less than a quarter of the ring to receive into? The
+// caller should copy packets and give their buffers back right
+// away then.
+int virtio_net_recv_low(int qid) {
+  struct rxq *rx = &net_recv[qid];
+  return rx->nlent > rx->q.num/2 - rx->q.num/8;
+}
 
+// The n ring buffers in slot[], lent out by virtio_net_recv() from
+// one rx queue, are no longer in use. They go back on the recv queue
+// with the next batch, or right away if the device is running short
+// of buffers.
+void virtio_net_recv_done(int *slot, int n) {
+  if (n <= 0)
+    return;
+  struct rxq *rx = &net_recv[SLOT_QUEUE(slot[0])];
+  struct virtq *q = &rx->q;
+
+  acquire(&rx->lock);
+  for (int i = 0; i < n; i++) {
+    int k = SLOT_INDEX(slot[i]);
+    if (SLOT_QUEUE(slot[i]) != rx - net_recv || k >= q->num/2 ||
+        rx->nlent <= 0)
+      panic("virtio_net_recv_done");
+    rx->nlent--;
+    rx->refill[rx->nrefill++] = k;
+  }
+  if (q->num/2 - rx->nlent - rx->nrefill < q->num/8)
+    refill(rx);
+  release(&rx->lock);
+}
+
+// Give every finished send, on every tx queue, back to the
+// network stack.
+void virtio_net_reclaim(void) {
+  for (int i = 0; i < npairs; i++)
+    reclaim_send(&net_send[i]);
+}
+
+// Handle a VIRTIO1_IRQ. Acknowledge the interrupt and leave the
+// finished sends and received packets of all queues to the
+// network thread; virtio-mmio has one interrupt for all of them.
+void virtio_net_intr(void) {
+  // acked before netintr(), so a packet that lands after the
+  // network thread looked at the used ring raises a new interrupt.
+  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+
+  netintr();
+}
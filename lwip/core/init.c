@@ -229,6 +229,9 @@ PACK_STRUCT_END
 #if LWIP_TCP && LWIP_NETIF_TX_SINGLE_PBUF && !TCP_OVERSIZE
 #error "LWIP_NETIF_TX_SINGLE_PBUF needs TCP_OVERSIZE enabled to create single-pbuf TCP packets"
 #endif
+#if LWIP_TCP_TSO && LWIP_NETIF_TX_SINGLE_PBUF
+#error "LWIP_TCP_TSO sends TCP packets in several pbufs, it does not work with LWIP_NETIF_TX_SINGLE_PBUF"
+#endif
 #if LWIP_NETCONN && LWIP_TCP
 #if NETCONN_COPY != TCP_WRITE_FLAG_COPY
 #error "NETCONN_COPY != TCP_WRITE_FLAG_COPY"
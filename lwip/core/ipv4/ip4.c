@@ -998,7 +998,12 @@ ip4_output_if_opt_src(struct pbuf *p, const ip4_addr_t *src, const ip4_addr_t *d
 #endif /* ENABLE_LOOPBACK */
 #if IP_FRAG
   /* don't fragment if interface has mtu set to 0 [loopif] */
-  if (netif->mtu && (p->tot_len > netif->mtu)) {
+  if (netif->mtu && (p->tot_len > netif->mtu)
+#if LWIP_TCP_TSO
+      /* nor TCP segments the netif will segment itself */
+      && (p->tso_mss == 0)
+#endif /* LWIP_TCP_TSO */
+     ) {
     return ip4_frag(p, netif, dest);
   }
 #endif /* IP_FRAG */
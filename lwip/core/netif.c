@@ -324,6 +324,10 @@ netif_add(struct netif *netif,
 #endif /* LWIP_IPV6 */
   NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL);
   netif->mtu = 0;
+#if LWIP_TCP_TSO
+  netif->tso_max = 0;
+  netif->tso_max_pbufs = 0;
+#endif /* LWIP_TCP_TSO */
   netif->flags = 0;
 #ifdef netif_get_client_data
   memset(netif->client_data, 0, sizeof(netif->client_data));
@@ -186,6 +186,9 @@ pbuf_init_alloced_pbuf(struct pbuf *p, void *payload, u16_t tot_len, u16_t len,
   p->flags = flags;
   p->ref = 1;
   p->if_idx = NETIF_NO_INDEX;
+#if LWIP_TCP_TSO
+  p->tso_mss = 0;
+#endif /* LWIP_TCP_TSO */
 }
 
 /**
@@ -184,6 +184,352 @@ struct tcp_pcb **const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcbs
 
 u8_t tcp_active_pcbs_changed;
 
+#if TCP_PCB_HASH_SIZE
+/** tcp_active_pcbs, hashed by tcp_hash_conn() */
+struct tcp_pcb *tcp_active_hash[TCP_PCB_HASH_SIZE];
+/** tcp_tw_pcbs, hashed by tcp_hash_conn() */
+struct tcp_pcb *tcp_tw_hash[TCP_PCB_HASH_SIZE];
+/** tcp_listen_pcbs, hashed by TCP_HASH_LISTEN() */
+struct tcp_pcb_listen *tcp_listen_hash[TCP_PCB_HASH_SIZE];
+
+/**
+ * The bucket of a connection in tcp_active_hash and tcp_tw_hash.
+ * The local address is left out: it is the same for most connections.
+ */
+u32_t
+tcp_hash_conn(u16_t local_port, const ip_addr_t *remote_ip, u16_t remote_port)
+{
+  u32_t h;
+
+#if LWIP_IPV6
+  if (IP_IS_V6(remote_ip)) {
+    const u32_t *a = ip_2_ip6(remote_ip)->addr;
+    h = a[0] ^ a[1] ^ a[2] ^ a[3];
+  } else
+#endif /* LWIP_IPV6 */
+  {
+    h = ip4_addr_get_u32(ip_2_ip4(remote_ip));
+  }
+  h ^= ((u32_t)remote_port << 16) | local_port;
+  h ^= h >> 16;
+  h *= 2654435761UL;
+  return (h >> 16) & (TCP_PCB_HASH_SIZE - 1);
+}
+
+/** Called from TCP_REG: add pcb, just put on list pcbs, to its table. */
+void
+tcp_hash_reg(struct tcp_pcb **pcbs, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **head;
+
+  if (pcbs == &tcp_active_pcbs) {
+    head = &tcp_active_hash[tcp_hash_conn(pcb->local_port, &pcb->remote_ip, pcb->remote_port)];
+  } else if (pcbs == &tcp_tw_pcbs) {
+    head = &tcp_tw_hash[tcp_hash_conn(pcb->local_port, &pcb->remote_ip, pcb->remote_port)];
+  } else if (pcbs == &tcp_listen_pcbs.pcbs) {
+    head = (struct tcp_pcb **)&tcp_listen_hash[TCP_HASH_LISTEN(pcb->local_port)];
+  } else {
+    /* tcp_bound_pcbs: tcp_input() never looks for those */
+    pcb->hpprev = NULL;
+    return;
+  }
+  pcb->hnext = *head;
+  if (pcb->hnext != NULL) {
+    pcb->hnext->hpprev = &pcb->hnext;
+  }
+  pcb->hpprev = head;
+  *head = pcb;
+}
+
+/** Called from TCP_RMV: take pcb out of its table, if it is in one. */
+void
+tcp_hash_rmv(struct tcp_pcb *pcb)
+{
+  if (pcb->hpprev == NULL) {
+    return;
+  }
+  *pcb->hpprev = pcb->hnext;
+  if (pcb->hnext != NULL) {
+    pcb->hnext->hpprev = pcb->hpprev;
+  }
+  pcb->hnext = NULL;
+  pcb->hpprev = NULL;
+}
+#endif /* TCP_PCB_HASH_SIZE */
+
+#if TCP_TW_WHEEL_SIZE
+/** tcp_tw_pcbs, by the slow timer tick their 2*MSL ends in (modulo the
+    wheel size), chained through pcb->tw_wnext */
+static struct tcp_pcb *tcp_tw_wheel[TCP_TW_WHEEL_SIZE];
+
+#define TCP_TW_SLOT(pcb) \
+  (&tcp_tw_wheel[((pcb)->tmr + 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1) & (TCP_TW_WHEEL_SIZE - 1)])
+
+static void
+tcp_tw_wheel_add(struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **slot = TCP_TW_SLOT(pcb);
+
+  pcb->tw_wnext = *slot;
+  *slot = pcb;
+}
+
+static void
+tcp_tw_wheel_del(struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **pp;
+
+  for (pp = TCP_TW_SLOT(pcb); *pp != NULL; pp = &(*pp)->tw_wnext) {
+    if (*pp == pcb) {
+      *pp = pcb->tw_wnext;
+      break;
+    }
+  }
+  pcb->tw_wnext = NULL;
+}
+
+/** Called from TCP_REG: pcb has just been put on tcp_tw_pcbs. */
+void
+tcp_tw_reg(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT("tcp_tw_reg: pcb first on tcp_tw_pcbs", tcp_tw_pcbs == pcb);
+  pcb->tw_pprev = &tcp_tw_pcbs;
+  if (pcb->next != NULL) {
+    pcb->next->tw_pprev = &pcb->next;
+  }
+  tcp_tw_wheel_add(pcb);
+}
+
+/** Take pcb off tcp_tw_pcbs and the wheel, without walking the list. */
+void
+tcp_tw_rmv(struct tcp_pcb *pcb)
+{
+  *pcb->tw_pprev = pcb->next;
+  if (pcb->next != NULL) {
+    pcb->next->tw_pprev = pcb->tw_pprev;
+  }
+  pcb->next = NULL;
+  pcb->tw_pprev = NULL;
+  TCP_HASH_RMV(pcb);
+  tcp_tw_wheel_del(pcb);
+}
+
+/** Restart the 2*MSL of pcb, in TIME-WAIT. */
+void
+tcp_tw_restart(struct tcp_pcb *pcb)
+{
+  tcp_tw_wheel_del(pcb);
+  pcb->tmr = tcp_ticks;
+  tcp_tw_wheel_add(pcb);
+}
+#endif /* TCP_TW_WHEEL_SIZE */
+
+#if TCP_ACTIVE_WHEEL_SIZE
+/** tcp_active_pcbs, by the slow timer tick of their next timer event
+    (modulo the wheel size), doubly linked through pcb->wnext */
+static struct tcp_pcb *tcp_active_wheel[TCP_ACTIVE_WHEEL_SIZE];
+/** The active pcbs with a delayed ACK, a pending FIN or refused data,
+    for tcp_fasttmr(), doubly linked through pcb->fnext */
+static struct tcp_pcb *tcp_fast_pcbs;
+
+static void
+tcp_tmr_wheel_add(struct tcp_pcb *pcb, u32_t due)
+{
+  struct tcp_pcb **slot = &tcp_active_wheel[due & (TCP_ACTIVE_WHEEL_SIZE - 1)];
+
+  pcb->wdue = due;
+  pcb->wnext = *slot;
+  if (pcb->wnext != NULL) {
+    pcb->wnext->wpprev = &pcb->wnext;
+  }
+  pcb->wpprev = slot;
+  *slot = pcb;
+}
+
+static void
+tcp_tmr_wheel_del(struct tcp_pcb *pcb)
+{
+  *pcb->wpprev = pcb->wnext;
+  if (pcb->wnext != NULL) {
+    pcb->wnext->wpprev = pcb->wpprev;
+  }
+  pcb->wnext = NULL;
+  pcb->wpprev = NULL;
+}
+
+static void
+tcp_tmr_fast_del(struct tcp_pcb *pcb)
+{
+  *pcb->fpprev = pcb->fnext;
+  if (pcb->fnext != NULL) {
+    pcb->fnext->fpprev = pcb->fpprev;
+  }
+  pcb->fnext = NULL;
+  pcb->fpprev = NULL;
+}
+
+/**
+ * Count the slow timer ticks from pcb->wtick to now into the tick
+ * counters of pcb, as tcp_slowtmr() would have. None of them was due,
+ * so counting is all it would have done.
+ */
+static void
+tcp_tmr_catchup(struct tcp_pcb *pcb, u32_t now)
+{
+  u32_t n = now - pcb->wtick;
+
+  if (n == 0) {
+    return;
+  }
+  pcb->wtick = now;
+  if (pcb->persist_backoff > 0) {
+    u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff - 1];
+    pcb->persist_cnt = (u8_t)LWIP_MIN(pcb->persist_cnt + n, backoff_cnt);
+  } else if (pcb->rtime >= 0) {
+    pcb->rtime = (s16_t)LWIP_MIN((u32_t)pcb->rtime + n, 0x7FFF);
+  }
+  if (pcb->pollinterval > 0) {
+    pcb->polltmr = (u8_t)LWIP_MIN(pcb->polltmr + n, pcb->pollinterval - 1U);
+  }
+}
+
+#define TCP_TMR_EARLIER(due, tick) do {  \
+    u32_t tcp_tmr_tick = (tick);         \
+    if (TCP_SEQ_LT(tcp_tmr_tick, due)) { \
+      (due) = tcp_tmr_tick;              \
+    }                                    \
+  } while (0)
+
+/**
+ * The first slow timer tick after tcp_ticks in which tcp_slowtmr() has
+ * work for pcb, whose tick counters are up to date. With none in sight,
+ * a turn of the wheel from now, to notice options set meanwhile.
+ */
+static u32_t
+tcp_tmr_due(struct tcp_pcb *pcb)
+{
+  u32_t due = tcp_ticks + TCP_ACTIVE_WHEEL_SIZE;
+
+  if ((pcb->state == SYN_SENT && pcb->nrtx >= TCP_SYNMAXRTX) ||
+      pcb->nrtx >= TCP_MAXRTX) {
+    return tcp_ticks + 1;
+  }
+  if (pcb->persist_backoff > 0) {
+    u8_t backoff_cnt = tcp_persist_backoff[pcb->persist_backoff - 1];
+    if (pcb->persist_probe >= TCP_MAXRTX || pcb->persist_cnt >= backoff_cnt) {
+      return tcp_ticks + 1;
+    }
+    TCP_TMR_EARLIER(due, tcp_ticks + backoff_cnt - pcb->persist_cnt);
+  } else if (pcb->rtime >= 0) {
+    if (pcb->rtime >= pcb->rto) {
+      return tcp_ticks + 1;
+    }
+    TCP_TMR_EARLIER(due, tcp_ticks + (u32_t)(pcb->rto - pcb->rtime));
+  }
+  if (pcb->state == FIN_WAIT_2 && (pcb->flags & TF_RXCLOSED)) {
+    TCP_TMR_EARLIER(due, pcb->tmr + TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL + 1);
+  }
+  if (ip_get_option(pcb, SOF_KEEPALIVE) &&
+      ((pcb->state == ESTABLISHED) ||
+       (pcb->state == CLOSE_WAIT))) {
+    TCP_TMR_EARLIER(due, pcb->tmr + (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL + 1);
+    TCP_TMR_EARLIER(due, pcb->tmr + (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb))
+                    / TCP_SLOW_INTERVAL + 1);
+  }
+#if TCP_QUEUE_OOSEQ
+  if (pcb->ooseq != NULL) {
+    TCP_TMR_EARLIER(due, pcb->tmr + (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT);
+  }
+#endif /* TCP_QUEUE_OOSEQ */
+  if (pcb->state == SYN_RCVD) {
+    TCP_TMR_EARLIER(due, pcb->tmr + TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL + 1);
+  }
+  if (pcb->state == LAST_ACK) {
+    TCP_TMR_EARLIER(due, pcb->tmr + 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1);
+  }
+  /* A pcb without a poll callback is not woken up only to be polled. */
+#if LWIP_CALLBACK_API
+  if (pcb->poll != NULL)
+#endif /* LWIP_CALLBACK_API */
+  {
+    TCP_TMR_EARLIER(due, tcp_ticks + (pcb->polltmr < pcb->pollinterval ?
+                                      pcb->pollinterval - pcb->polltmr : 1));
+  }
+  /* a timeout that has passed is retried in the next tick */
+  if (TCP_SEQ_LEQ(due, tcp_ticks)) {
+    due = tcp_ticks + 1;
+  }
+  return due;
+}
+
+/** Called from TCP_REG: pcb has just been put on tcp_active_pcbs. */
+void
+tcp_tmr_reg(struct tcp_pcb *pcb)
+{
+  pcb->wtick = tcp_ticks;
+  tcp_tmr_wheel_add(pcb, tcp_tmr_due(pcb));
+  if ((pcb->flags & (TF_ACK_DELAY | TF_CLOSEPEND)) || pcb->refused_data != NULL) {
+    tcp_tmr_fast(pcb);
+  }
+}
+
+/** Called from TCP_RMV: take pcb off the wheel and tcp_fast_pcbs. */
+void
+tcp_tmr_rmv(struct tcp_pcb *pcb)
+{
+  if (pcb->wpprev != NULL) {
+    tcp_tmr_wheel_del(pcb);
+  }
+  if (pcb->fpprev != NULL) {
+    tcp_tmr_fast_del(pcb);
+  }
+}
+
+/** Bring the tick counters of pcb up to date, if it is active. */
+void
+tcp_tmr_sync(struct tcp_pcb *pcb)
+{
+  if (pcb->wpprev != NULL) {
+    tcp_tmr_catchup(pcb, tcp_ticks);
+  }
+}
+
+/**
+ * A timer of active pcb has been started or restarted: move pcb to an
+ * earlier slot of the wheel if it is now due sooner.
+ */
+void
+tcp_tmr_resched(struct tcp_pcb *pcb)
+{
+  u32_t due;
+
+  if (pcb->wpprev == NULL) {
+    return;
+  }
+  tcp_tmr_catchup(pcb, tcp_ticks);
+  due = tcp_tmr_due(pcb);
+  if (TCP_SEQ_LT(due, pcb->wdue)) {
+    tcp_tmr_wheel_del(pcb);
+    tcp_tmr_wheel_add(pcb, due);
+  }
+}
+
+/** Put active pcb on tcp_fast_pcbs, if it is not on it yet. */
+void
+tcp_tmr_fast(struct tcp_pcb *pcb)
+{
+  if (pcb->wpprev == NULL || pcb->fpprev != NULL) {
+    return;
+  }
+  pcb->fnext = tcp_fast_pcbs;
+  if (pcb->fnext != NULL) {
+    pcb->fnext->fpprev = &pcb->fnext;
+  }
+  pcb->fpprev = &tcp_fast_pcbs;
+  tcp_fast_pcbs = pcb;
+}
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
+
 /** Timer counter to handle calling slow-timer from tcp_tmr() */
 static u8_t tcp_timer;
 static u8_t tcp_timer_ctr;
@@ -449,6 +795,7 @@ tcp_close_shutdown_fin(struct tcp_pcb *pcb)
   } else if (err == ERR_MEM) {
     /* Mark this pcb for closing. Closing is retried from tcp_tmr. */
     tcp_set_flags(pcb, TF_CLOSEPEND);
+    TCP_TMR_FAST(pcb);
     /* We have to return ERR_OK from here to indicate to the callers that this
        pcb should not be used any more as it will be freed soon via tcp_tmr.
        This is OK here since sending FIN does not guarantee a time frime for
@@ -493,6 +840,8 @@ tcp_close(struct tcp_pcb *pcb)
   if (pcb->state != LISTEN) {
     /* Set a flag not to receive any more data... */
     tcp_set_flags(pcb, TF_RXCLOSED);
+    /* ... which starts the FIN-WAIT-2 timeout */
+    TCP_TMR_RESCHED(pcb);
   }
   /* ... and close */
   return tcp_close_shutdown(pcb, 1);
@@ -524,6 +873,7 @@ tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx)
   if (shut_rx) {
     /* shut down the receive side: set a flag not to receive any more data... */
     tcp_set_flags(pcb, TF_RXCLOSED);
+    TCP_TMR_RESCHED(pcb);
     if (shut_tx) {
       /* shutting down the tx AND rx side is the same as closing for the raw API */
       return tcp_close_shutdown(pcb, 1);
@@ -1192,7 +1542,12 @@ void
 tcp_slowtmr(void)
 {
   struct tcp_pcb *pcb, *prev;
-  tcpwnd_size_t eff_wnd;
+#if TCP_TW_WHEEL_SIZE
+  struct tcp_pcb **pp;
+#endif /* TCP_TW_WHEEL_SIZE */
+#if TCP_ACTIVE_WHEEL_SIZE
+  struct tcp_pcb *due;
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -1202,6 +1557,31 @@ tcp_slowtmr(void)
   ++tcp_ticks;
   ++tcp_timer_ctr;
 
+#if TCP_ACTIVE_WHEEL_SIZE
+  /* Steps through the active PCBs whose next timer event may be in this
+     tick. They are moved from the wheel to the list due, and stay on it
+     (where tcp_pcb_remove() can find them) until they are put back on
+     the wheel at their next event. */
+  due = tcp_active_wheel[tcp_ticks & (TCP_ACTIVE_WHEEL_SIZE - 1)];
+  tcp_active_wheel[tcp_ticks & (TCP_ACTIVE_WHEEL_SIZE - 1)] = NULL;
+  if (due != NULL) {
+    due->wpprev = &due;
+  }
+  while ((pcb = due) != NULL) {
+    if (TCP_SEQ_GT(pcb->wdue, tcp_ticks)) {
+      /* a later turn of the wheel */
+      tcp_tmr_wheel_del(pcb);
+      tcp_tmr_wheel_add(pcb, pcb->wdue);
+      continue;
+    }
+    LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: processing active pcb\n"));
+    LWIP_ASSERT("tcp_slowtmr: active pcb->state != CLOSED\n", pcb->state != CLOSED);
+    LWIP_ASSERT("tcp_slowtmr: active pcb->state != LISTEN\n", pcb->state != LISTEN);
+    LWIP_ASSERT("tcp_slowtmr: active pcb->state != TIME-WAIT\n", pcb->state != TIME_WAIT);
+    /* count the ticks it slept through; this one is counted below */
+    tcp_tmr_catchup(pcb, tcp_ticks - 1);
+    pcb->wtick = tcp_ticks;
+#else /* TCP_ACTIVE_WHEEL_SIZE */
 tcp_slowtmr_start:
   /* Steps through all of the active PCBs. */
   prev = NULL;
@@ -1221,6 +1601,7 @@ tcp_slowtmr_start:
       continue;
     }
     pcb->last_timer = tcp_timer_ctr;
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
 
     pcb_remove = 0;
     pcb_reset = 0;
@@ -1293,16 +1674,10 @@ tcp_slowtmr_start:
             pcb->rtime = 0;
 
             /* Reduce congestion window and ssthresh. */
-            eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
-            pcb->ssthresh = eff_wnd >> 1;
-            if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
-              pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
-            }
-            pcb->cwnd = pcb->mss;
+            pcb->cc->on_rto(pcb);
             LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
                                          " ssthresh %"TCPWNDSIZE_F"\n",
                                          pcb->cwnd, pcb->ssthresh));
-            pcb->bytes_acked = 0;
 
             /* The following needs to be called AFTER cwnd is set to one
                mss - STJ */
@@ -1384,6 +1759,10 @@ tcp_slowtmr_start:
       void *err_arg;
       enum tcp_state last_state;
       tcp_pcb_purge(pcb);
+#if TCP_ACTIVE_WHEEL_SIZE
+      /* Remove PCB from tcp_active_pcbs list, and from due. */
+      TCP_RMV(&tcp_active_pcbs, pcb);
+#else /* TCP_ACTIVE_WHEEL_SIZE */
       /* Remove PCB from tcp_active_pcbs list. */
       if (prev != NULL) {
         LWIP_ASSERT("tcp_slowtmr: middle tcp != tcp_active_pcbs", pcb != tcp_active_pcbs);
@@ -1393,6 +1772,8 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_active_pcbs", tcp_active_pcbs == pcb);
         tcp_active_pcbs = pcb->next;
       }
+      TCP_HASH_RMV(pcb);
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
 
       if (pcb_reset) {
         tcp_rst(pcb, pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
@@ -1407,23 +1788,39 @@ tcp_slowtmr_start:
 
       tcp_active_pcbs_changed = 0;
       TCP_EVENT_ERR(last_state, err_fn, err_arg, ERR_ABRT);
+#if !TCP_ACTIVE_WHEEL_SIZE
       if (tcp_active_pcbs_changed) {
         goto tcp_slowtmr_start;
       }
+#endif /* !TCP_ACTIVE_WHEEL_SIZE */
     } else {
       /* get the 'next' element now and work with 'prev' below (in case of abort) */
       prev = pcb;
+#if !TCP_ACTIVE_WHEEL_SIZE
       pcb = pcb->next;
+#endif /* !TCP_ACTIVE_WHEEL_SIZE */
 
       /* We check if we should poll the connection. */
       ++prev->polltmr;
       if (prev->polltmr >= prev->pollinterval) {
         prev->polltmr = 0;
+      }
+#if TCP_ACTIVE_WHEEL_SIZE
+      /* back on the wheel before the poll callback, which may free it */
+      tcp_tmr_wheel_del(prev);
+      tcp_tmr_wheel_add(prev, tcp_tmr_due(prev));
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
+      if (prev->polltmr == 0) {
         LWIP_DEBUGF(TCP_DEBUG, ("tcp_slowtmr: polling application\n"));
         tcp_active_pcbs_changed = 0;
         TCP_EVENT_POLL(prev, err);
         if (tcp_active_pcbs_changed) {
+#if TCP_ACTIVE_WHEEL_SIZE
+          /* prev may be gone; due is still sound */
+          continue;
+#else /* TCP_ACTIVE_WHEEL_SIZE */
           goto tcp_slowtmr_start;
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
         }
         /* if err == ERR_ABRT, 'prev' is already deallocated */
         if (err == ERR_OK) {
@@ -1434,6 +1831,24 @@ tcp_slowtmr_start:
   }
 
 
+#if TCP_TW_WHEEL_SIZE
+  /* Steps through the TIME-WAIT PCBs whose 2*MSL may end in this tick. */
+  pp = &tcp_tw_wheel[tcp_ticks & (TCP_TW_WHEEL_SIZE - 1)];
+  while ((pcb = *pp) != NULL) {
+    LWIP_ASSERT("tcp_slowtmr: TIME-WAIT pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
+
+    /* Check if this PCB has stayed long enough in TIME-WAIT */
+    if ((u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+      tcp_pcb_purge(pcb);
+      /* takes it off the wheel too, so *pp is its successor */
+      tcp_tw_rmv(pcb);
+      tcp_free(pcb);
+    } else {
+      /* a later turn of the wheel */
+      pp = &pcb->tw_wnext;
+    }
+  }
+#else /* TCP_TW_WHEEL_SIZE */
   /* Steps through all of the TIME-WAIT PCBs. */
   prev = NULL;
   pcb = tcp_tw_pcbs;
@@ -1459,6 +1874,7 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_tw_pcbs", tcp_tw_pcbs == pcb);
         tcp_tw_pcbs = pcb->next;
       }
+      TCP_HASH_RMV(pcb);
       pcb2 = pcb;
       pcb = pcb->next;
       tcp_free(pcb2);
@@ -1467,6 +1883,7 @@ tcp_slowtmr_start:
       pcb = pcb->next;
     }
   }
+#endif /* TCP_TW_WHEEL_SIZE */
 }
 
 /**
@@ -1479,9 +1896,47 @@ void
 tcp_fasttmr(void)
 {
   struct tcp_pcb *pcb;
+#if TCP_ACTIVE_WHEEL_SIZE
+  struct tcp_pcb *due;
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
 
   ++tcp_timer_ctr;
 
+#if TCP_ACTIVE_WHEEL_SIZE
+  /* Steps through the active PCBs this timer has work for, moved from
+     tcp_fast_pcbs to the list due. */
+  due = tcp_fast_pcbs;
+  tcp_fast_pcbs = NULL;
+  if (due != NULL) {
+    due->fpprev = &due;
+  }
+  while ((pcb = due) != NULL) {
+    /* off due first, so that work this run leaves for the next one
+       (a FIN that failed again) puts it back on tcp_fast_pcbs */
+    tcp_tmr_fast_del(pcb);
+    /* send delayed ACKs */
+    if (pcb->flags & TF_ACK_DELAY) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_fasttmr: delayed ACK\n"));
+      tcp_ack_now(pcb);
+      tcp_output(pcb);
+      tcp_clear_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    }
+    /* send pending FIN */
+    if (pcb->flags & TF_CLOSEPEND) {
+      LWIP_DEBUGF(TCP_DEBUG, ("tcp_fasttmr: pending FIN\n"));
+      tcp_clear_flags(pcb, TF_CLOSEPEND);
+      tcp_close_shutdown_fin(pcb);
+    }
+
+    /* If there is data which was previously "refused" by upper layer,
+       keep the pcb for the next run until it is taken; the callback
+       may free the pcb, which takes it off again. */
+    if (pcb->refused_data != NULL) {
+      tcp_tmr_fast(pcb);
+      tcp_process_refused_data(pcb);
+    }
+  }
+#else /* TCP_ACTIVE_WHEEL_SIZE */
 tcp_fasttmr_start:
   pcb = tcp_active_pcbs;
 
@@ -1519,6 +1974,7 @@ tcp_fasttmr_start:
       pcb = pcb->next;
     }
   }
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
 }
 
 /** Call tcp_output for all active pcbs that have TF_NAGLEMEMERR set */
@@ -1593,6 +2049,7 @@ tcp_process_refused_data(struct tcp_pcb *pcb)
       }
 #endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
       pcb->refused_data = refused_data;
+      TCP_TMR_FAST(pcb);
       return ERR_INPROGRESS;
     }
   }
@@ -1911,6 +2368,8 @@ tcp_alloc(u8_t prio)
     connection is established. To avoid these complications, we set ssthresh to the
     largest effective cwnd (amount of in-flight data) that the sender can have. */
     pcb->ssthresh = TCP_SND_BUF;
+    pcb->cc = &TCP_CC_DEFAULT;
+    pcb->cc->init(pcb);
 
 #if LWIP_CALLBACK_API
     pcb->recv = tcp_recv_null;
@@ -2115,6 +2574,7 @@ tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
   LWIP_UNUSED_ARG(poll);
 #endif /* LWIP_CALLBACK_API */
   pcb->pollinterval = interval;
+  TCP_TMR_RESCHED(pcb);
 }
 
 /**
@@ -2179,7 +2639,14 @@ tcp_pcb_remove(struct tcp_pcb **pcblist, struct tcp_pcb *pcb)
   LWIP_ASSERT("tcp_pcb_remove: invalid pcb", pcb != NULL);
   LWIP_ASSERT("tcp_pcb_remove: invalid pcblist", pcblist != NULL);
 
-  TCP_RMV(pcblist, pcb);
+#if TCP_TW_WHEEL_SIZE
+  if (pcblist == &tcp_tw_pcbs) {
+    tcp_tw_rmv(pcb);
+  } else
+#endif /* TCP_TW_WHEEL_SIZE */
+  {
+    TCP_RMV(pcblist, pcb);
+  }
 
   tcp_pcb_purge(pcb);
 
@@ -0,0 +1,318 @@
+/**
+ * @file
+ * Transmission Control Protocol, congestion control
+ *
+ * The algorithms that drive a connection's cwnd and ssthresh, each a
+ * struct tcp_cc_ops. tcp_in.c, tcp_out.c and tcp.c call them on acks
+ * of new data, on fast retransmit and on retransmission timeouts.
+ * A connection starts with TCP_CC_DEFAULT; tcp_set_cc() changes it.
+ *
+ * - NewReno (RFC 5681, with RFC 3465 byte counting): what lwIP did
+ *   before these were pluggable.
+ * - CUBIC (RFC 8312): grows cwnd as a cubic function of the time
+ *   since the last loss, so that it gets back to the window of the
+ *   loss fast, however long the round trip.
+ */
+
+/*
+ * This file is part of the lwIP TCP/IP stack.
+ */
+
+#include "lwip/opt.h"
+
+#if LWIP_TCP /* don't build if not configured for use in lwipopts.h */
+
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sys.h"
+#include <string.h>
+
+/* smoothed round trip time in ms, 0 if not measured yet */
+static u32_t
+tcp_cc_srtt(struct tcp_pcb *pcb)
+{
+  if (pcb->sa <= 0) {
+    return 0;
+  }
+  return (u32_t)(pcb->sa >> 3) * TCP_SLOW_INTERVAL;
+}
+
+/* RFC 3465, section 2.2 Slow Start */
+static void
+tcp_cc_slow_start(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  tcpwnd_size_t increase;
+  /* limit to 1 SMSS segment during period following RTO */
+  u8_t num_seg = (pcb->flags & TF_RTO) ? 1 : 2;
+
+  increase = LWIP_MIN(acked, (tcpwnd_size_t)(num_seg * pcb->mss));
+  TCP_WND_INC(pcb->cwnd, increase);
+}
+
+/* ssthresh after a loss: cwnd (or the peer's window, if smaller) times
+   factor/10, and at least 2 MSS */
+static void
+tcp_cc_reduce(struct tcp_pcb *pcb, u32_t factor)
+{
+  tcpwnd_size_t eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
+
+  pcb->ssthresh = (tcpwnd_size_t)(((u64_t)eff_wnd * factor) / 10);
+  if (pcb->ssthresh < (tcpwnd_size_t)(2 * pcb->mss)) {
+    pcb->ssthresh = (tcpwnd_size_t)(2 * pcb->mss);
+  }
+}
+
+/* pacing rate of both: a window per round trip */
+static u32_t
+tcp_cc_window_rate(struct tcp_pcb *pcb)
+{
+  u32_t srtt = tcp_cc_srtt(pcb);
+
+  if (srtt == 0) {
+    return 0;
+  }
+  return (u32_t)LWIP_MIN(((u64_t)pcb->cwnd * 1000) / srtt, 0xffffffffUL);
+}
+
+/*-------------------------------- NewReno --------------------------------*/
+
+static void
+newreno_init(struct tcp_pcb *pcb)
+{
+  pcb->bytes_acked = 0;
+}
+
+static void
+newreno_on_ack(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  if (pcb->cwnd < pcb->ssthresh) {
+    tcp_cc_slow_start(pcb, acked);
+  } else {
+    /* RFC 3465, section 2.1 Congestion Avoidance */
+    TCP_WND_INC(pcb->bytes_acked, acked);
+    if (pcb->bytes_acked >= pcb->cwnd) {
+      pcb->bytes_acked = (tcpwnd_size_t)(pcb->bytes_acked - pcb->cwnd);
+      TCP_WND_INC(pcb->cwnd, pcb->mss);
+    }
+  }
+}
+
+static void
+newreno_on_loss(struct tcp_pcb *pcb)
+{
+  tcp_cc_reduce(pcb, 5);
+  pcb->cwnd = (tcpwnd_size_t)(pcb->ssthresh + 3 * pcb->mss);
+}
+
+static void
+newreno_on_rto(struct tcp_pcb *pcb)
+{
+  tcp_cc_reduce(pcb, 5);
+  pcb->cwnd = pcb->mss;
+  pcb->bytes_acked = 0;
+}
+
+const struct tcp_cc_ops tcp_cc_newreno = {
+  "newreno",
+  newreno_init,
+  newreno_on_ack,
+  newreno_on_loss,
+  newreno_on_rto,
+  tcp_cc_window_rate
+};
+
+/*--------------------------------- CUBIC ---------------------------------*/
+
+/* CUBIC's state, in pcb->cc_priv */
+struct cubic {
+  u32_t w_max;    /* cwnd (bytes) at the last loss */
+  u32_t origin;   /* cwnd the cubic function plateaus at */
+  u32_t k;        /* ms from the epoch to the plateau */
+  u32_t epoch;    /* sys_now() when growth began, 0 if not yet */
+  u32_t w_est;    /* what standard TCP would have grown cwnd to */
+};
+
+/* C = 0.4 and beta = 0.7, as RFC 8312 recommends; beta in tenths */
+#define CUBIC_BETA 7
+
+/* the largest |t - K| in ms that the cubic is evaluated at, so that
+   its cube times 4 * mss fits in 64 bits */
+#define CUBIC_MAX_DT (1 << 19)
+
+static struct cubic *
+cubic_state(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT("cubic state fits", sizeof(struct cubic) <= sizeof(pcb->cc_priv));
+  return (struct cubic *)pcb->cc_priv;
+}
+
+/* integer cube root, rounded down */
+static u32_t
+cubic_root(u64_t a)
+{
+  u32_t x = 0;
+  int s;
+
+  for (s = 21; s >= 0; s--) {
+    u64_t y = x | (1UL << s);
+    if (y * y * y <= a) {
+      x = (u32_t)y;
+    }
+  }
+  return x;
+}
+
+static void
+cubic_init(struct tcp_pcb *pcb)
+{
+  memset(pcb->cc_priv, 0, sizeof(pcb->cc_priv));
+  pcb->bytes_acked = 0;
+}
+
+/* a loss ends the epoch; remember the window it happened at */
+static void
+cubic_loss(struct tcp_pcb *pcb)
+{
+  struct cubic *c = cubic_state(pcb);
+
+  c->epoch = 0;
+  if (pcb->cwnd < c->w_max) {
+    /* fast convergence: leave room for newer flows */
+    c->w_max = (u32_t)(((u64_t)pcb->cwnd * (10 + CUBIC_BETA)) / 20);
+  } else {
+    c->w_max = pcb->cwnd;
+  }
+  tcp_cc_reduce(pcb, CUBIC_BETA);
+}
+
+static void
+cubic_on_ack(struct tcp_pcb *pcb, tcpwnd_size_t acked)
+{
+  struct cubic *c = cubic_state(pcb);
+  u32_t now = sys_now();
+  u32_t target, inc;
+  s64_t dt, delta;
+
+  if (pcb->cwnd < pcb->ssthresh) {
+    tcp_cc_slow_start(pcb, acked);
+    return;
+  }
+
+  if (c->epoch == 0) {
+    /* first ack of a new congestion avoidance epoch */
+    c->epoch = now ? now : 1;
+    c->w_est = pcb->cwnd;
+    if (c->w_max > pcb->cwnd) {
+      /* K = cbrt((W_max - cwnd) / C), in segments and seconds */
+      c->k = cubic_root(((u64_t)(c->w_max - pcb->cwnd) * 2500000000UL) / pcb->mss);
+      c->origin = c->w_max;
+    } else {
+      c->k = 0;
+      c->origin = pcb->cwnd;
+    }
+  }
+
+  /* W(t) = C * (t - K)^3 + W_max, looking one round trip ahead */
+  dt = (s64_t)(u32_t)(now - c->epoch) + tcp_cc_srtt(pcb) - c->k;
+  dt = LWIP_MAX(LWIP_MIN(dt, CUBIC_MAX_DT), -CUBIC_MAX_DT);
+  delta = ((dt * dt * dt) / 1000000) * 4 * pcb->mss / 10000;
+  if (delta < 0 && (u64_t)-delta >= c->origin) {
+    target = pcb->mss;
+  } else {
+    target = (u32_t)LWIP_MIN((s64_t)c->origin + delta, (s64_t)0x7fffffff);
+  }
+
+  /* never slower than standard TCP: 3(1-beta)/(1+beta) = 9/17 of a
+     segment per window acked */
+  c->w_est += (u32_t)(((u64_t)acked * pcb->mss * 9) / (17 * (u64_t)pcb->cwnd));
+  if (c->w_est > target) {
+    target = c->w_est;
+  }
+
+  if (target > pcb->cwnd) {
+    /* close the gap over one window of acks, at most 1.5x per round */
+    inc = (u32_t)(((u64_t)(target - pcb->cwnd) * acked) / pcb->cwnd);
+    inc = LWIP_MIN(inc, acked / 2);
+    TCP_WND_INC(pcb->cwnd, (tcpwnd_size_t)inc);
+  }
+}
+
+static void
+cubic_on_loss(struct tcp_pcb *pcb)
+{
+  cubic_loss(pcb);
+  pcb->cwnd = (tcpwnd_size_t)(pcb->ssthresh + 3 * pcb->mss);
+}
+
+static void
+cubic_on_rto(struct tcp_pcb *pcb)
+{
+  cubic_loss(pcb);
+  pcb->cwnd = pcb->mss;
+  pcb->bytes_acked = 0;
+}
+
+const struct tcp_cc_ops tcp_cc_cubic = {
+  "cubic",
+  cubic_init,
+  cubic_on_ack,
+  cubic_on_loss,
+  cubic_on_rto,
+  tcp_cc_window_rate
+};
+
+/*-------------------------------------------------------------------------*/
+
+static const struct tcp_cc_ops *const tcp_ccs[] = {
+  &tcp_cc_newreno,
+  &tcp_cc_cubic
+};
+
+/**
+ * @ingroup tcp_raw
+ * Look up a congestion control algorithm by name ("newreno", "cubic").
+ *
+ * @return the algorithm, or NULL if there is none of that name
+ */
+const struct tcp_cc_ops *
+tcp_cc_find(const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < LWIP_ARRAYSIZE(tcp_ccs); i++) {
+    if (strcmp(tcp_ccs[i]->name, name) == 0) {
+      return tcp_ccs[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @ingroup tcp_raw
+ * Make cc the congestion control algorithm of pcb. It takes over from
+ * the current cwnd and ssthresh.
+ */
+void
+tcp_set_cc(struct tcp_pcb *pcb, const struct tcp_cc_ops *cc)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("tcp_set_cc: invalid pcb", pcb != NULL, return);
+  LWIP_ERROR("tcp_set_cc: invalid cc", cc != NULL, return);
+
+  pcb->cc = cc;
+  cc->init(pcb);
+}
+
+/**
+ * @ingroup tcp_raw
+ * The rate in bytes per second that pcb's congestion control would
+ * pace sending at; 0 if it does not know yet. lwIP itself does not
+ * pace: tcp_output() sends what the windows allow right away.
+ */
+u32_t
+tcp_pacing_rate(struct tcp_pcb *pcb)
+{
+  LWIP_ASSERT("tcp_pacing_rate: invalid pcb", pcb != NULL);
+  return pcb->cc->pacing_rate(pcb);
+}
+
+#endif /* LWIP_TCP */
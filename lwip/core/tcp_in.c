@@ -123,6 +123,9 @@ tcp_input(struct pbuf *p, struct netif *inp)
   struct tcp_pcb *lpcb_prev = NULL;
   struct tcp_pcb_listen *lpcb_any = NULL;
 #endif /* SO_REUSE */
+#if TCP_PCB_HASH_SIZE
+  u32_t hash;
+#endif /* TCP_PCB_HASH_SIZE */
   u8_t hdrlen_bytes;
   err_t err;
 
@@ -247,7 +250,13 @@ tcp_input(struct pbuf *p, struct netif *inp)
      for an active connection. */
   prev = NULL;
 
+#if TCP_PCB_HASH_SIZE
+  /* only the pcbs in the segment's bucket can match */
+  hash = tcp_hash_conn(tcphdr->dest, ip_current_src_addr(), tcphdr->src);
+  for (pcb = tcp_active_hash[hash]; pcb != NULL; pcb = pcb->hnext) {
+#else /* TCP_PCB_HASH_SIZE */
   for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* TCP_PCB_HASH_SIZE */
     LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
     LWIP_ASSERT("tcp_input: active pcb->state != LISTEN", pcb->state != LISTEN);
@@ -263,6 +272,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
         pcb->local_port == tcphdr->dest &&
         ip_addr_cmp(&pcb->remote_ip, ip_current_src_addr()) &&
         ip_addr_cmp(&pcb->local_ip, ip_current_dest_addr())) {
+#if !TCP_PCB_HASH_SIZE
       /* Move this PCB to the front of the list so that subsequent
          lookups will be faster (we exploit locality in TCP segment
          arrivals). */
@@ -275,6 +285,8 @@ tcp_input(struct pbuf *p, struct netif *inp)
         TCP_STATS_INC(tcp.cachehit);
       }
       LWIP_ASSERT("tcp_input: pcb->next != pcb (after cache)", pcb->next != pcb);
+#endif /* !TCP_PCB_HASH_SIZE */
+      TCP_TMR_SYNC(pcb);
       break;
     }
     prev = pcb;
@@ -283,7 +295,11 @@ tcp_input(struct pbuf *p, struct netif *inp)
   if (pcb == NULL) {
     /* If it did not go to an active connection, we check the connections
        in the TIME-WAIT state. */
+#if TCP_PCB_HASH_SIZE
+    for (pcb = tcp_tw_hash[hash]; pcb != NULL; pcb = pcb->hnext) {
+#else /* TCP_PCB_HASH_SIZE */
     for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* TCP_PCB_HASH_SIZE */
       LWIP_ASSERT("tcp_input: TIME-WAIT pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
 
       /* check if PCB is bound to specific netif */
@@ -315,7 +331,11 @@ tcp_input(struct pbuf *p, struct netif *inp)
     /* Finally, if we still did not get a match, we check all PCBs that
        are LISTENing for incoming connections. */
     prev = NULL;
+#if TCP_PCB_HASH_SIZE
+    for (lpcb = tcp_listen_hash[TCP_HASH_LISTEN(tcphdr->dest)]; lpcb != NULL; lpcb = lpcb->hnext) {
+#else /* TCP_PCB_HASH_SIZE */
     for (lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next) {
+#endif /* TCP_PCB_HASH_SIZE */
       /* check if PCB is bound to specific netif */
       if ((lpcb->netif_idx != NETIF_NO_INDEX) &&
           (lpcb->netif_idx != netif_get_index(ip_data.current_input_netif))) {
@@ -358,6 +378,10 @@ tcp_input(struct pbuf *p, struct netif *inp)
     }
 #endif /* SO_REUSE */
     if (lpcb != NULL) {
+#if TCP_PCB_HASH_SIZE
+      /* prev is in the bucket's chain, not the list */
+      LWIP_UNUSED_ARG(prev);
+#else /* TCP_PCB_HASH_SIZE */
       /* Move this PCB to the front of the list so that subsequent
          lookups will be faster (we exploit locality in TCP segment
          arrivals). */
@@ -370,6 +394,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
       } else {
         TCP_STATS_INC(tcp.cachehit);
       }
+#endif /* TCP_PCB_HASH_SIZE */
 
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: packed for LISTENing connection.\n"));
 #ifdef LWIP_HOOK_TCP_INPACKET_PCB
@@ -516,6 +541,7 @@ tcp_input(struct pbuf *p, struct netif *inp)
             }
 #endif /* TCP_QUEUE_OOSEQ && LWIP_WND_SCALE */
             pcb->refused_data = recv_data;
+            TCP_TMR_FAST(pcb);
             LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_input: keep incoming packet, because pcb is \"full\"\n"));
 #if TCP_QUEUE_OOSEQ && LWIP_WND_SCALE
             break;
@@ -762,7 +788,11 @@ tcp_timewait_input(struct tcp_pcb *pcb)
   } else if (flags & TCP_FIN) {
     /* - eighth, check the FIN bit: Remain in the TIME-WAIT state.
          Restart the 2 MSL time-wait timeout.*/
+#if TCP_TW_WHEEL_SIZE
+    tcp_tw_restart(pcb);
+#else /* TCP_TW_WHEEL_SIZE */
     pcb->tmr = tcp_ticks;
+#endif /* TCP_TW_WHEEL_SIZE */
   }
 
   if ((tcplen > 0)) {
@@ -895,6 +925,7 @@ tcp_process(struct tcp_pcb *pcb)
         } else {
           pcb->rtime = 0;
           pcb->nrtx = 0;
+          TCP_TMR_RESCHED(pcb);
         }
 
         /* Call the user specified function to call when successfully
@@ -915,6 +946,7 @@ tcp_process(struct tcp_pcb *pcb)
           have, or we might get caught in a loop on loopback interfaces. */
         if (pcb->nrtx < TCP_SYNMAXRTX) {
           pcb->rtime = 0;
+          TCP_TMR_RESCHED(pcb);
           tcp_rexmit_rto(pcb);
         }
       }
@@ -1254,23 +1286,8 @@ tcp_receive(struct tcp_pcb *pcb)
       /* Update the congestion control variables (cwnd and
          ssthresh). */
       if (pcb->state >= ESTABLISHED) {
-        if (pcb->cwnd < pcb->ssthresh) {
-          tcpwnd_size_t increase;
-          /* limit to 1 SMSS segment during period following RTO */
-          u8_t num_seg = (pcb->flags & TF_RTO) ? 1 : 2;
-          /* RFC 3465, section 2.2 Slow Start */
-          increase = LWIP_MIN(acked, (tcpwnd_size_t)(num_seg * pcb->mss));
-          TCP_WND_INC(pcb->cwnd, increase);
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: slow start cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
-        } else {
-          /* RFC 3465, section 2.1 Congestion Avoidance */
-          TCP_WND_INC(pcb->bytes_acked, acked);
-          if (pcb->bytes_acked >= pcb->cwnd) {
-            pcb->bytes_acked = (tcpwnd_size_t)(pcb->bytes_acked - pcb->cwnd);
-            TCP_WND_INC(pcb->cwnd, pcb->mss);
-          }
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: congestion avoidance cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
-        }
+        pcb->cc->on_ack(pcb, acked);
+        LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_receive: cwnd %"TCPWNDSIZE_F"\n", pcb->cwnd));
       }
       LWIP_DEBUGF(TCP_INPUT_DEBUG, ("tcp_receive: ACK for %"U32_F", unacked->seqno %"U32_F":%"U32_F"\n",
                                     ackno,
@@ -1296,6 +1313,7 @@ tcp_receive(struct tcp_pcb *pcb)
         pcb->rtime = -1;
       } else {
         pcb->rtime = 0;
+        TCP_TMR_RESCHED(pcb);
       }
 
       pcb->polltmr = 0;
@@ -1358,6 +1376,7 @@ tcp_receive(struct tcp_pcb *pcb)
       m = (s16_t)(m - (pcb->sv >> 2));
       pcb->sv = (s16_t)(pcb->sv + m);
       pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
+      TCP_TMR_RESCHED(pcb);
 
       LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: RTO %"U16_F" (%"U16_F" milliseconds)\n",
                                   pcb->rto, (u16_t)(pcb->rto * TCP_SLOW_INTERVAL)));
@@ -1648,6 +1667,8 @@ tcp_receive(struct tcp_pcb *pcb)
         /* We queue the segment on the ->ooseq queue. */
         if (pcb->ooseq == NULL) {
           pcb->ooseq = tcp_seg_copy(&inseg);
+          /* which starts the ooseq timeout */
+          TCP_TMR_RESCHED(pcb);
 #if LWIP_TCP_SACK_OUT
           if (pcb->flags & TF_SACK) {
             /* All the SACKs should be invalid, so we can simply store the most recent one: */
@@ -125,7 +125,11 @@
 #endif
 
 /* Forward declarations.*/
-static err_t tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif);
+static err_t tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif, struct pbuf *tso);
+#if LWIP_TCP_TSO
+static u16_t tcp_output_tso_count(struct tcp_pcb *pcb, struct tcp_seg *seg, u32_t wnd, struct netif *netif);
+static struct pbuf *tcp_output_tso_alloc(struct tcp_seg *seg, u16_t n);
+#endif /* LWIP_TCP_TSO */
 
 /* tcp_route: common code that returns a fixed bound netif or calls ip_route */
 static struct netif *
@@ -1240,6 +1244,10 @@ tcp_output(struct tcp_pcb *pcb)
   u32_t wnd, snd_nxt;
   err_t err;
   struct netif *netif;
+#if LWIP_TCP_TSO
+  struct pbuf *tso;
+  u16_t tso_left = 0;
+#endif /* LWIP_TCP_TSO */
 #if TCP_CWND_DEBUG
   s16_t i = 0;
 #endif /* TCP_CWND_DEBUG */
@@ -1259,6 +1267,9 @@ tcp_output(struct tcp_pcb *pcb)
     return ERR_OK;
   }
 
+  /* the timers below count from now */
+  TCP_TMR_SYNC(pcb);
+
   wnd = LWIP_MIN(pcb->snd_wnd, pcb->cwnd);
 
   seg = pcb->unsent;
@@ -1313,6 +1324,7 @@ tcp_output(struct tcp_pcb *pcb)
       pcb->persist_cnt = 0;
       pcb->persist_backoff = 1;
       pcb->persist_probe = 0;
+      TCP_TMR_RESCHED(pcb);
     }
     /* We need an ACK, but can't send data now, so send an empty ACK */
     if (pcb->flags & TF_ACK_NOW) {
@@ -1357,7 +1369,24 @@ tcp_output(struct tcp_pcb *pcb)
       TCPH_SET_FLAG(seg->tcphdr, TCP_ACK);
     }
 
-    err = tcp_output_segment(seg, pcb, netif);
+#if LWIP_TCP_TSO
+    if (tso_left > 0) {
+      /* sent in the packet of the segment before */
+      tso_left--;
+      MIB2_STATS_INC(mib2.tcpoutsegs);
+      err = ERR_OK;
+    } else {
+      /* send the segments after it along if the netif can cut them up */
+      tso = NULL;
+      tso_left = tcp_output_tso_count(pcb, seg, wnd, netif);
+      if ((tso_left > 0) && ((tso = tcp_output_tso_alloc(seg, tso_left)) == NULL)) {
+        tso_left = 0;
+      }
+      err = tcp_output_segment(seg, pcb, netif, tso);
+    }
+#else /* LWIP_TCP_TSO */
+    err = tcp_output_segment(seg, pcb, netif, NULL);
+#endif /* LWIP_TCP_TSO */
     if (err != ERR_OK) {
       /* segment could not be sent, for whatever reason */
       tcp_set_flags(pcb, TF_NAGLEMEMERR);
@@ -1444,16 +1473,163 @@ tcp_output_segment_busy(const struct tcp_seg *seg)
   return 0;
 }
 
+#if LWIP_TCP_TSO
+/** Offset of the data of seg in its first pbuf */
+static u16_t
+tcp_seg_data_offset(const struct tcp_seg *seg)
+{
+  return (u16_t)(((u8_t *)seg->tcphdr - (u8_t *)seg->p->payload) + TCPH_HDRLEN_BYTES(seg->tcphdr));
+}
+
+/** Number of pbufs holding the data of seg: segments referencing
+    their data (tcp_write() without TCP_WRITE_FLAG_COPY) take several */
+static u16_t
+tcp_seg_data_clen(const struct tcp_seg *seg)
+{
+  u16_t clen = pbuf_clen(seg->p);
+
+  if (seg->p->len <= tcp_seg_data_offset(seg)) {
+    clen--;
+  }
+  return clen;
+}
+
+/**
+ * Called by tcp_output() before sending seg: count the unsent segments
+ * following it that can go out in the same packet, for the netif to
+ * segment in hardware. They must have data following on from seg's in
+ * sequence, fit into the send window and into netif->tso_max bytes and
+ * netif->tso_max_pbufs pbufs, and tcp_output() must not hold them back
+ * for Nagle once the ones before them are sent.
+ *
+ * @param pcb the tcp_pcb seg belongs to
+ * @param seg the first unsent segment, about to be sent
+ * @param wnd the usable send window
+ * @param netif the netif seg is sent on
+ * @return the number of segments after seg to send with it
+ */
+static u16_t
+tcp_output_tso_count(struct tcp_pcb *pcb, struct tcp_seg *seg, u32_t wnd, struct netif *netif)
+{
+  struct tcp_seg *next;
+  u32_t len, seqno;
+  u16_t clen, next_clen;
+  u16_t n = 0;
+
+  /* packets to our own address are looped back whole */
+  if ((netif->tso_max == 0) || (seg->len == 0) ||
+      (TCPH_FLAGS(seg->tcphdr) & (TCP_SYN | TCP_FIN)) || tcp_output_segment_busy(seg) ||
+      ip_addr_cmp(&pcb->remote_ip, &pcb->local_ip)) {
+    return 0;
+  }
+  len = IP_HLEN + TCPH_HDRLEN_BYTES(seg->tcphdr) + seg->len;
+  seqno = lwip_ntohl(seg->tcphdr->seqno) + seg->len;
+  /* the copy of the header takes one more */
+  clen = (u16_t)(1 + tcp_seg_data_clen(seg));
+
+  for (next = seg->next; next != NULL; next = next->next) {
+    next_clen = tcp_seg_data_clen(next);
+    if ((next->len == 0) || (next->flags != seg->flags) ||
+        (TCPH_FLAGS(next->tcphdr) & (TCP_SYN | TCP_FIN)) ||
+        (lwip_ntohl(next->tcphdr->seqno) != seqno) ||
+        (len + next->len > netif->tso_max) ||
+        ((netif->tso_max_pbufs != 0) && (clen + next_clen > netif->tso_max_pbufs)) ||
+        (seqno - pcb->lastack + next->len > wnd) ||
+        tcp_output_segment_busy(next)) {
+      break;
+    }
+    /* tcp_do_output_nagle() with next first on pcb->unsent */
+    if ((next->next == NULL) && (next->len < pcb->mss) &&
+        ((pcb->flags & (TF_NODELAY | TF_INFR | TF_NAGLEMEMERR | TF_FIN)) == 0) &&
+        (tcp_sndbuf(pcb) != 0) && (tcp_sndqueuelen(pcb) < TCP_SND_QUEUELEN)) {
+      break;
+    }
+    len += next->len;
+    seqno += next->len;
+    clen = (u16_t)(clen + next_clen);
+    n++;
+  }
+  return n;
+}
+
+/** Free-callback of a struct tcp_tso_pbuf, called by pbuf_free. */
+static void
+tcp_tso_pbuf_free(struct pbuf *p)
+{
+  struct tcp_tso_pbuf *tp = (struct tcp_tso_pbuf *)p;
+
+  pbuf_free(tp->seg_p);
+  memp_free(MEMP_TCP_TSO_PBUF, tp);
+}
+
+/**
+ * Make the packet tcp_output() sends seg and the n unsent segments
+ * after it in: room for a copy of seg's TCP header, which
+ * tcp_output_segment() fills in, followed by a PBUF_REF to each pbuf
+ * of their data. The segments are not changed.
+ *
+ * @param seg the first segment of the packet
+ * @param n the number of segments after seg
+ * @return the packet, or NULL if out of memory
+ */
+static struct pbuf *
+tcp_output_tso_alloc(struct tcp_seg *seg, u16_t n)
+{
+  struct pbuf *p, *q, *r;
+  struct tcp_tso_pbuf *tp;
+  u16_t off;
+
+  p = pbuf_alloc(PBUF_IP, TCPH_HDRLEN_BYTES(seg->tcphdr), PBUF_RAM);
+  if (p == NULL) {
+    return NULL;
+  }
+  for (;;) {
+    off = tcp_seg_data_offset(seg);
+    for (q = seg->p; q != NULL; q = q->next) {
+      if (q->len > off) {
+        tp = (struct tcp_tso_pbuf *)memp_malloc(MEMP_TCP_TSO_PBUF);
+        if (tp == NULL) {
+          pbuf_free(p);
+          return NULL;
+        }
+        r = pbuf_alloced_custom(PBUF_RAW, (u16_t)(q->len - off), PBUF_REF, &tp->pc,
+                                (u8_t *)q->payload + off, (u16_t)(q->len - off));
+        if (r == NULL) {
+          memp_free(MEMP_TCP_TSO_PBUF, tp);
+          pbuf_free(p);
+          return NULL;
+        }
+        pbuf_ref(seg->p);
+        tp->seg_p = seg->p;
+        tp->pc.custom_free_function = tcp_tso_pbuf_free;
+        pbuf_cat(p, r);
+      }
+      /* the header is all in the first pbuf */
+      off = 0;
+    }
+    if (n == 0) {
+      break;
+    }
+    n--;
+    seg = seg->next;
+  }
+  return p;
+}
+#endif /* LWIP_TCP_TSO */
+
 /**
  * Called by tcp_output() to actually send a TCP segment over IP.
  *
  * @param seg the tcp_seg to send
  * @param pcb the tcp_pcb for the TCP connection used to send the segment
  * @param netif the netif used to send the segment
+ * @param tso if not NULL, the packet of tcp_output_tso_alloc() to send
+ *        seg in, along with the segments after it
  */
 static err_t
-tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif)
+tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif, struct pbuf *tso)
 {
+  struct pbuf *p = seg->p;
   err_t err;
   u16_t len;
   u32_t *opts;
@@ -1465,7 +1641,9 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
   LWIP_ASSERT("tcp_output_segment: invalid pcb", pcb != NULL);
   LWIP_ASSERT("tcp_output_segment: invalid netif", netif != NULL);
 
-  if (tcp_output_segment_busy(seg)) {
+  /* the references of tso are ours; tcp_output_tso_count() checked
+     seg before tcp_output_tso_alloc() took them */
+  if ((tso == NULL) && tcp_output_segment_busy(seg)) {
     /* This should not happen: rexmit functions should have checked this.
        However, since this function modifies p->len, we must not continue in this case. */
     LWIP_DEBUGF(TCP_RTO_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_output_segment: segment busy\n"));
@@ -1533,6 +1711,7 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
      This must be set before checking the route. */
   if (pcb->rtime < 0) {
     pcb->rtime = 0;
+    TCP_TMR_RESCHED(pcb);
   }
 
   if (pcb->rttest == 0) {
@@ -1603,10 +1782,41 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
 #endif /* CHECKSUM_GEN_TCP */
   TCP_STATS_INC(tcp.xmit);
 
+#if LWIP_TCP_TSO
+  if (tso != NULL) {
+    /* send seg's header in front of the data of all the segments, and
+       tell the netif how to cut it up; it sets PSH on the last piece */
+    struct tcp_hdr *tcphdr = (struct tcp_hdr *)tso->payload;
+    u16_t mss;
+
+    MEMCPY(tcphdr, seg->tcphdr, TCPH_HDRLEN_BYTES(seg->tcphdr));
+    TCPH_SET_FLAG(tcphdr, TCP_PSH);
+#if CHECKSUM_GEN_TCP
+    IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_TCP) {
+      tcphdr->chksum = 0;
+      tcphdr->chksum = ip_chksum_pseudo(tso, IP_PROTO_TCP,
+                                        tso->tot_len, &pcb->local_ip, &pcb->remote_ip);
+    }
+#endif /* CHECKSUM_GEN_TCP */
+    mss = (u16_t)(pcb->mss - LWIP_TCP_OPT_LENGTH_SEGMENT(seg->flags, pcb));
+    if (tso->tot_len - TCPH_HDRLEN_BYTES(seg->tcphdr) > mss) {
+      tso->tso_mss = mss;
+    }
+    p = tso;
+  }
+#else /* LWIP_TCP_TSO */
+  LWIP_UNUSED_ARG(tso);
+#endif /* LWIP_TCP_TSO */
+
   NETIF_SET_HINTS(netif, &(pcb->netif_hints));
-  err = ip_output_if(seg->p, &pcb->local_ip, &pcb->remote_ip, pcb->ttl,
+  err = ip_output_if(p, &pcb->local_ip, &pcb->remote_ip, pcb->ttl,
                      pcb->tos, IP_PROTO_TCP, netif);
   NETIF_RESET_HINTS(netif);
+#if LWIP_TCP_TSO
+  if (tso != NULL) {
+    pbuf_free(tso);
+  }
+#endif /* LWIP_TCP_TSO */
 
 #if TCP_CHECKSUM_ON_COPY
   if (seg_chksum_was_swapped) {
@@ -1792,24 +2002,14 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  (u16_t)pcb->dupacks, pcb->lastack,
                  lwip_ntohl(pcb->unacked->tcphdr->seqno)));
     if (tcp_rexmit(pcb) == ERR_OK) {
-      /* Set ssthresh to half of the minimum of the current
-       * cwnd and the advertised window */
-      pcb->ssthresh = LWIP_MIN(pcb->cwnd, pcb->snd_wnd) / 2;
-
-      /* The minimum value for ssthresh should be 2 MSS */
-      if (pcb->ssthresh < (2U * pcb->mss)) {
-        LWIP_DEBUGF(TCP_FR_DEBUG,
-                    ("tcp_receive: The minimum value for ssthresh %"TCPWNDSIZE_F
-                     " should be min 2 mss %"U16_F"...\n",
-                     pcb->ssthresh, (u16_t)(2 * pcb->mss)));
-        pcb->ssthresh = 2 * pcb->mss;
-      }
-
-      pcb->cwnd = pcb->ssthresh + 3 * pcb->mss;
+      /* Reduce ssthresh, and inflate cwnd by the 3 segments
+       * that have left the network */
+      pcb->cc->on_loss(pcb);
       tcp_set_flags(pcb, TF_INFR);
 
       /* Reset the retransmission timer to prevent immediate rto retransmissions */
       pcb->rtime = 0;
+      TCP_TMR_RESCHED(pcb);
     }
   }
 }
@@ -2043,6 +2243,7 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   if (p == NULL) {
     /* let tcp_fasttmr retry sending this ACK */
     tcp_set_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    TCP_TMR_FAST(pcb);
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG, ("tcp_output: (ACK) could not allocate pbuf\n"));
     return ERR_BUF;
   }
@@ -2058,6 +2259,7 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   if (err != ERR_OK) {
     /* let tcp_fasttmr retry sending this ACK */
     tcp_set_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    TCP_TMR_FAST(pcb);
   } else {
     /* remove ACK flags from the PCB, as we sent an empty ACK now */
     tcp_clear_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
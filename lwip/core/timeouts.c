@@ -118,12 +118,30 @@ const int lwip_num_cyclic_timers = LWIP_ARRAYSIZE(lwip_cyclic_timers);
 
 #if LWIP_TIMERS && !LWIP_TIMERS_CUSTOM
 
+#if LWIP_TIMERS_WHEEL_SIZE
+/* The timeouts, hashed by due time: a timeout goes into the slot of
+   its time in wheel ticks of (1 << TIMEOUT_WHEEL_SHIFT) ms, modulo the
+   wheel size. Slots are not sorted and also hold timeouts of later
+   turns of the wheel, so whoever walks one checks each time. */
+#define TIMEOUT_WHEEL_SHIFT   4
+#define TIMEOUT_WHEEL_SLOT(t) ((u32_t)((t) >> TIMEOUT_WHEEL_SHIFT) & (LWIP_TIMERS_WHEEL_SIZE - 1))
+
+static struct sys_timeo *timeout_wheel[LWIP_TIMERS_WHEEL_SIZE];
+/** sys_now() of the last sys_check_timeouts(): the timeouts due before
+    it have all been called */
+static u32_t timeout_wheel_time;
+/** if timeout_wheel_next_valid, no timeout is due before this */
+static u32_t timeout_wheel_next;
+static u8_t timeout_wheel_next_valid;
+static u32_t timeout_wheel_count;
+#else /* LWIP_TIMERS_WHEEL_SIZE */
 /** The one and only timeout list */
 static struct sys_timeo *next_timeout;
+#endif /* LWIP_TIMERS_WHEEL_SIZE */
 
 static u32_t current_timeout_due_time;
 
-#if LWIP_TESTMODE
+#if LWIP_TESTMODE && !LWIP_TIMERS_WHEEL_SIZE
 struct sys_timeo**
 sys_timeouts_get_next_timeout(void)
 {
@@ -176,6 +194,59 @@ tcp_timer_needed(void)
 }
 #endif /* LWIP_TCP */
 
+#if LWIP_TIMERS_WHEEL_SIZE
+/** Put timeout into its slot of the wheel. */
+static void
+timeout_wheel_add(struct sys_timeo *timeout)
+{
+  struct sys_timeo **slot;
+
+  /* due already: the next sys_check_timeouts() starts at
+     timeout_wheel_time's slot, so that is where it has to go */
+  if (TIME_LESS_THAN(timeout->time, timeout_wheel_time)) {
+    slot = &timeout_wheel[TIMEOUT_WHEEL_SLOT(timeout_wheel_time)];
+  } else {
+    slot = &timeout_wheel[TIMEOUT_WHEEL_SLOT(timeout->time)];
+  }
+  timeout->next = *slot;
+  *slot = timeout;
+  timeout_wheel_count++;
+
+  if (timeout_wheel_next_valid && TIME_LESS_THAN(timeout->time, timeout_wheel_next)) {
+    timeout_wheel_next = timeout->time;
+  }
+}
+
+/** Find out when the next timeout is due, for sys_timeouts_sleeptime().
+ * Walks the slots from timeout_wheel_time on: the first one that holds
+ * a timeout of this turn of the wheel holds the earliest one.
+ */
+static void
+timeout_wheel_find_next(void)
+{
+  u32_t tick = timeout_wheel_time >> TIMEOUT_WHEEL_SHIFT;
+  u32_t i, end;
+  struct sys_timeo *t;
+  u8_t found = 0;
+
+  for (i = 0; i < LWIP_TIMERS_WHEEL_SIZE && !found; i++) {
+    end = (u32_t)((tick + i + 1) << TIMEOUT_WHEEL_SHIFT);
+    for (t = timeout_wheel[(tick + i) & (LWIP_TIMERS_WHEEL_SIZE - 1)]; t != NULL; t = t->next) {
+      if (TIME_LESS_THAN(t->time, end) &&
+          (!found || TIME_LESS_THAN(t->time, timeout_wheel_next))) {
+        timeout_wheel_next = t->time;
+        found = 1;
+      }
+    }
+  }
+  if (!found) {
+    /* all of them are a turn of the wheel away or more */
+    timeout_wheel_next = (u32_t)((tick + LWIP_TIMERS_WHEEL_SIZE) << TIMEOUT_WHEEL_SHIFT);
+  }
+  timeout_wheel_next_valid = 1;
+}
+#endif /* LWIP_TIMERS_WHEEL_SIZE */
+
 static void
 #if LWIP_DEBUG_TIMERNAMES
 sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg, const char *handler_name)
@@ -202,6 +273,10 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
                              (void *)timeout, abs_time, handler_name, (void *)arg));
 #endif /* LWIP_DEBUG_TIMERNAMES */
 
+#if LWIP_TIMERS_WHEEL_SIZE
+  LWIP_UNUSED_ARG(t);
+  timeout_wheel_add(timeout);
+#else /* LWIP_TIMERS_WHEEL_SIZE */
   if (next_timeout == NULL) {
     next_timeout = timeout;
     return;
@@ -218,6 +293,7 @@ sys_timeout_abs(u32_t abs_time, sys_timeout_handler handler, void *arg)
       }
     }
   }
+#endif /* LWIP_TIMERS_WHEEL_SIZE */
 }
 
 /**
@@ -264,6 +340,9 @@ lwip_cyclic_timer(void *arg)
 void sys_timeouts_init(void)
 {
   size_t i;
+#if LWIP_TIMERS_WHEEL_SIZE
+  timeout_wheel_time = sys_now();
+#endif /* LWIP_TIMERS_WHEEL_SIZE */
   /* tcp_tmr() at index 0 is started on demand */
   for (i = (LWIP_TCP ? 1 : 0); i < LWIP_ARRAYSIZE(lwip_cyclic_timers); i++) {
     /* we have to cast via size_t to get rid of const warning
@@ -316,6 +395,30 @@ sys_timeout(u32_t msecs, sys_timeout_handler handler, void *arg)
 void
 sys_untimeout(sys_timeout_handler handler, void *arg)
 {
+#if LWIP_TIMERS_WHEEL_SIZE
+  struct sys_timeo **pp, **first = NULL;
+  struct sys_timeo *t;
+  u32_t i;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  /* the first to be due of the matching ones, wherever it is */
+  for (i = 0; i < LWIP_TIMERS_WHEEL_SIZE; i++) {
+    for (pp = &timeout_wheel[i]; *pp != NULL; pp = &(*pp)->next) {
+      if (((*pp)->h == handler) && ((*pp)->arg == arg) &&
+          ((first == NULL) || TIME_LESS_THAN((*pp)->time, (*first)->time))) {
+        first = pp;
+      }
+    }
+  }
+  if (first != NULL) {
+    t = *first;
+    *first = t->next;
+    timeout_wheel_count--;
+    timeout_wheel_next_valid = 0;
+    memp_free(MEMP_SYS_TIMEOUT, t);
+  }
+#else /* LWIP_TIMERS_WHEEL_SIZE */
   struct sys_timeo *prev_t, *t;
 
   LWIP_ASSERT_CORE_LOCKED();
@@ -337,6 +440,7 @@ sys_untimeout(sys_timeout_handler handler, void *arg)
       return;
     }
   }
+#endif /* LWIP_TIMERS_WHEEL_SIZE */
   return;
 }
 
@@ -352,12 +456,68 @@ void
 sys_check_timeouts(void)
 {
   u32_t now;
+#if LWIP_TIMERS_WHEEL_SIZE
+  u32_t tick, n, i;
+#endif /* LWIP_TIMERS_WHEEL_SIZE */
 
   LWIP_ASSERT_CORE_LOCKED();
 
   /* Process only timers expired at the start of the function. */
   now = sys_now();
 
+#if LWIP_TIMERS_WHEEL_SIZE
+  PBUF_CHECK_FREE_OOSEQ();
+
+  /* the slots of the ticks since the last call, at most all of them */
+  tick = timeout_wheel_time >> TIMEOUT_WHEEL_SHIFT;
+  n = (u32_t)(now - (u32_t)(tick << TIMEOUT_WHEEL_SHIFT)) >> TIMEOUT_WHEEL_SHIFT;
+  if (n >= LWIP_TIMERS_WHEEL_SIZE) {
+    n = LWIP_TIMERS_WHEEL_SIZE - 1;
+  }
+  for (i = 0; i <= n; i++) {
+    struct sys_timeo **slot = &timeout_wheel[(tick + i) & (LWIP_TIMERS_WHEEL_SIZE - 1)];
+    struct sys_timeo **pp = slot;
+
+    while (*pp != NULL) {
+      struct sys_timeo *tmptimeout = *pp;
+      sys_timeout_handler handler;
+      void *arg;
+
+      if (TIME_LESS_THAN(now, tmptimeout->time)) {
+        /* later in this tick, or a later turn of the wheel */
+        pp = &tmptimeout->next;
+        continue;
+      }
+
+      /* Timeout has expired */
+      *pp = tmptimeout->next;
+      timeout_wheel_count--;
+      timeout_wheel_next_valid = 0;
+      handler = tmptimeout->h;
+      arg = tmptimeout->arg;
+      current_timeout_due_time = tmptimeout->time;
+#if LWIP_DEBUG_TIMERNAMES
+      if (handler != NULL) {
+        LWIP_DEBUGF(TIMERS_DEBUG, ("sct calling h=%s t=%"U32_F" arg=%p\n",
+                                   tmptimeout->handler_name, sys_now() - tmptimeout->time, arg));
+      }
+#endif /* LWIP_DEBUG_TIMERNAMES */
+      memp_free(MEMP_SYS_TIMEOUT, tmptimeout);
+      if (handler != NULL) {
+        handler(arg);
+      }
+      LWIP_TCPIP_THREAD_ALIVE();
+      PBUF_CHECK_FREE_OOSEQ();
+
+      /* the handler may have added to or taken from this slot */
+      pp = slot;
+    }
+  }
+  timeout_wheel_time = now;
+  if (timeout_wheel_next_valid && !TIME_LESS_THAN(now, timeout_wheel_next)) {
+    timeout_wheel_next_valid = 0;
+  }
+#else /* LWIP_TIMERS_WHEEL_SIZE */
   do {
     struct sys_timeo *tmptimeout;
     sys_timeout_handler handler;
@@ -393,6 +553,7 @@ sys_check_timeouts(void)
 
     /* Repeat until all expired timers have been called */
   } while (1);
+#endif /* LWIP_TIMERS_WHEEL_SIZE */
 }
 
 /** Rebase the timeout times to the current time.
@@ -406,6 +567,38 @@ sys_restart_timeouts(void)
   u32_t now;
   u32_t base;
   struct sys_timeo *t;
+#if LWIP_TIMERS_WHEEL_SIZE
+  struct sys_timeo *all = NULL;
+  u32_t i;
+
+  if (timeout_wheel_count == 0) {
+    return;
+  }
+
+  /* take them all off the wheel, and put them back rebased */
+  base = 0;
+  for (i = 0; i < LWIP_TIMERS_WHEEL_SIZE; i++) {
+    while ((t = timeout_wheel[i]) != NULL) {
+      timeout_wheel[i] = t->next;
+      if ((all == NULL) || TIME_LESS_THAN(t->time, base)) {
+        base = t->time;
+      }
+      t->next = all;
+      all = t;
+    }
+  }
+
+  now = sys_now();
+  timeout_wheel_count = 0;
+  timeout_wheel_time = now;
+  timeout_wheel_next_valid = 0;
+
+  while ((t = all) != NULL) {
+    all = t->next;
+    t->time = (t->time - base) + now;
+    timeout_wheel_add(t);
+  }
+#else /* LWIP_TIMERS_WHEEL_SIZE */
 
   if (next_timeout == NULL) {
     return;
@@ -417,6 +610,7 @@ sys_restart_timeouts(void)
   for (t = next_timeout; t != NULL; t = t->next) {
     t->time = (t->time - base) + now;
   }
+#endif /* LWIP_TIMERS_WHEEL_SIZE */
 }
 
 /** Return the time left before the next timeout is due. If no timeouts are
@@ -426,17 +620,29 @@ u32_t
 sys_timeouts_sleeptime(void)
 {
   u32_t now;
+  u32_t next_time;
 
   LWIP_ASSERT_CORE_LOCKED();
 
+#if LWIP_TIMERS_WHEEL_SIZE
+  if (timeout_wheel_count == 0) {
+    return SYS_TIMEOUTS_SLEEPTIME_INFINITE;
+  }
+  if (!timeout_wheel_next_valid) {
+    timeout_wheel_find_next();
+  }
+  next_time = timeout_wheel_next;
+#else /* LWIP_TIMERS_WHEEL_SIZE */
   if (next_timeout == NULL) {
     return SYS_TIMEOUTS_SLEEPTIME_INFINITE;
   }
+  next_time = next_timeout->time;
+#endif /* LWIP_TIMERS_WHEEL_SIZE */
   now = sys_now();
-  if (TIME_LESS_THAN(next_timeout->time, now)) {
+  if (TIME_LESS_THAN(next_time, now)) {
     return 0;
   } else {
-    u32_t ret = (u32_t)(next_timeout->time - now);
+    u32_t ret = (u32_t)(next_time - now);
     LWIP_ASSERT("invalid sleeptime", ret <= LWIP_MAX_TIMEOUT);
     return ret;
   }
@@ -333,6 +333,13 @@ struct netif {
 #endif /* LWIP_CHECKSUM_CTRL_PER_NETIF*/
   /** maximum transfer unit (in bytes) */
   u16_t mtu;
+#if LWIP_TCP_TSO
+  /** largest IP packet (in bytes) carrying a TCP segment the netif
+   *  segments itself; 0 if it does not do TCP segmentation offload */
+  u16_t tso_max;
+  /** most pbufs such a packet may be made of; 0 for no limit */
+  u16_t tso_max_pbufs;
+#endif /* LWIP_TCP_TSO */
 #if LWIP_IPV6 && LWIP_ND6_ALLOW_RA_UPDATES
   /** maximum transfer unit (in bytes), updated by RA */
   u16_t mtu6;
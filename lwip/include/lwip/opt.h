@@ -120,6 +120,17 @@
 #if !defined LWIP_TIMERS_CUSTOM || defined __DOXYGEN__
 #define LWIP_TIMERS_CUSTOM              0
 #endif
+
+/**
+ * LWIP_TIMERS_WHEEL_SIZE: when not 0, keep the timeouts of sys_timeout()
+ * in a hashed timer wheel of this many slots (a power of two) rather
+ * than a sorted list: adding a timeout no longer walks the timeouts due
+ * before it, and sys_check_timeouts() only looks at the slots of the
+ * time that has passed. sys_untimeout() looks at every slot.
+ */
+#if !defined LWIP_TIMERS_WHEEL_SIZE || defined __DOXYGEN__
+#define LWIP_TIMERS_WHEEL_SIZE          0
+#endif
 /**
  * @}
  */
@@ -481,6 +492,16 @@
 #define MEMP_NUM_FRAG_PBUF              15
 #endif
 
+/**
+ * MEMP_NUM_TCP_TSO_PBUF: the number of PBUF_REFs to segment data in
+ * TCP packets the netif segments (see LWIP_TCP_TSO) that are being
+ * sent at the same time. One per pbuf of data; when they run out,
+ * tcp_output() sends the segments one by one.
+ */
+#if !defined MEMP_NUM_TCP_TSO_PBUF || defined __DOXYGEN__
+#define MEMP_NUM_TCP_TSO_PBUF           TCP_SND_QUEUELEN
+#endif
+
 /**
  * MEMP_NUM_ARP_QUEUE: the number of simultaneously queued outgoing
  * packets (pbufs) that are waiting for an ARP request (to resolve
@@ -1268,6 +1289,60 @@
 #define LWIP_TCP_SACK_OUT               0
 #endif
 
+/**
+ * LWIP_TCP_TSO==1: Let TCP hand segments of up to netif->tso_max bytes
+ * to netifs that segment them in hardware (TCP segmentation offload).
+ * tcp_output() sends adjacent unsent segments as one packet, a copy of
+ * the first one's header followed by PBUF_REFs to the data of each,
+ * and marks it with the MSS the netif should cut it into
+ * (pbuf->tso_mss). The segments themselves stay as they are, so they
+ * are retransmitted one by one.
+ */
+#if !defined LWIP_TCP_TSO || defined __DOXYGEN__
+#define LWIP_TCP_TSO                    0
+#endif
+
+/**
+ * TCP_PCB_HASH_SIZE: when not 0, tcp_input() finds the pcb of a segment
+ * in hash tables instead of walking the pcb lists: active and TIME-WAIT
+ * pcbs by their addresses and ports, listening pcbs by their port.
+ * The number of buckets of each table, a power of two.
+ */
+#if !defined TCP_PCB_HASH_SIZE || defined __DOXYGEN__
+#define TCP_PCB_HASH_SIZE               0
+#endif
+
+/**
+ * TCP_TW_WHEEL_SIZE: when not 0, TIME-WAIT pcbs also go on a timer
+ * wheel of this many slots (a power of two), one per slow timer tick,
+ * so that tcp_slowtmr() only looks at the pcbs whose 2*MSL ends in
+ * that tick instead of at all of them. Best at least
+ * 2 * TCP_MSL / TCP_SLOW_INTERVAL + 1 slots.
+ */
+#if !defined TCP_TW_WHEEL_SIZE || defined __DOXYGEN__
+#define TCP_TW_WHEEL_SIZE               0
+#endif
+
+/**
+ * TCP_ACTIVE_WHEEL_SIZE: when not 0, active pcbs go on a timer wheel of
+ * this many slots (a power of two), one per slow timer tick, at the tick
+ * of their next retransmission, persist, keepalive, poll or state
+ * timeout; and on a list for tcp_fasttmr() while they have a delayed
+ * ACK, a pending FIN or refused data. tcp_slowtmr() and tcp_fasttmr()
+ * then look only at those pcbs instead of at all of tcp_active_pcbs.
+ */
+#if !defined TCP_ACTIVE_WHEEL_SIZE || defined __DOXYGEN__
+#define TCP_ACTIVE_WHEEL_SIZE           0
+#endif
+
+/**
+ * TCP_CC_DEFAULT: the congestion control algorithm (struct tcp_cc_ops)
+ * of new connections; tcp_set_cc() changes it per connection.
+ */
+#if !defined TCP_CC_DEFAULT || defined __DOXYGEN__
+#define TCP_CC_DEFAULT                  tcp_cc_newreno
+#endif
+
 /**
  * LWIP_TCP_MAX_SACK_NUM: The maximum number of SACK values to include in TCP segments.
  * Must be at least 1, but is only used if LWIP_TCP_SACK_OUT is enabled.
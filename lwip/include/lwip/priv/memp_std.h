@@ -50,6 +50,9 @@ LWIP_MEMPOOL(UDP_PCB,        MEMP_NUM_UDP_PCB,         sizeof(struct udp_pcb),
 LWIP_MEMPOOL(TCP_PCB,        MEMP_NUM_TCP_PCB,         sizeof(struct tcp_pcb),        "TCP_PCB")
 LWIP_MEMPOOL(TCP_PCB_LISTEN, MEMP_NUM_TCP_PCB_LISTEN,  sizeof(struct tcp_pcb_listen), "TCP_PCB_LISTEN")
 LWIP_MEMPOOL(TCP_SEG,        MEMP_NUM_TCP_SEG,         sizeof(struct tcp_seg),        "TCP_SEG")
+#if LWIP_TCP_TSO
+LWIP_MEMPOOL(TCP_TSO_PBUF,   MEMP_NUM_TCP_TSO_PBUF,    sizeof(struct tcp_tso_pbuf),   "TCP_TSO_PBUF")
+#endif /* LWIP_TCP_TSO */
 #endif /* LWIP_TCP */
 
 #if LWIP_ALTCP && LWIP_TCP
@@ -273,6 +273,16 @@ struct tcp_seg {
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
+#if LWIP_TCP_TSO
+/* A PBUF_REF to the data of a segment in a packet the netif segments
+   (see tcp_output()). It holds a reference to the segment's first
+   pbuf, so the segment counts as busy until the netif is done. */
+struct tcp_tso_pbuf {
+  struct pbuf_custom pc;
+  struct pbuf *seg_p;
+};
+#endif /* LWIP_TCP_TSO */
+
 #define LWIP_TCP_OPT_EOL        0
 #define LWIP_TCP_OPT_NOP        1
 #define LWIP_TCP_OPT_MSS        2
@@ -343,6 +353,83 @@ extern struct tcp_pcb *tcp_tw_pcbs;      /* List of all TCP PCBs in TIME-WAIT. *
 #define NUM_TCP_PCB_LISTS               4
 extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
 
+#if TCP_PCB_HASH_SIZE
+/* The same pcbs hashed, for tcp_input(): active and TIME-WAIT pcbs by
+   tcp_hash_conn(), listening pcbs by TCP_HASH_LISTEN() of their port.
+   Chained through pcb->hnext; TCP_REG and TCP_RMV keep them in step
+   with the lists. */
+extern struct tcp_pcb *tcp_active_hash[TCP_PCB_HASH_SIZE];
+extern struct tcp_pcb *tcp_tw_hash[TCP_PCB_HASH_SIZE];
+extern struct tcp_pcb_listen *tcp_listen_hash[TCP_PCB_HASH_SIZE];
+
+#define TCP_HASH_LISTEN(port) (((u32_t)(port) * 2654435761UL >> 16) & (TCP_PCB_HASH_SIZE - 1))
+u32_t tcp_hash_conn(u16_t local_port, const ip_addr_t *remote_ip, u16_t remote_port);
+void  tcp_hash_reg(struct tcp_pcb **pcbs, struct tcp_pcb *pcb);
+void  tcp_hash_rmv(struct tcp_pcb *pcb);
+
+#define TCP_HASH_REG(pcbs, npcb) tcp_hash_reg(pcbs, npcb)
+#define TCP_HASH_RMV(npcb)       tcp_hash_rmv(npcb)
+#else /* TCP_PCB_HASH_SIZE */
+#define TCP_HASH_REG(pcbs, npcb)
+#define TCP_HASH_RMV(npcb)
+#endif /* TCP_PCB_HASH_SIZE */
+
+#if TCP_TW_WHEEL_SIZE
+/* TIME-WAIT pcbs are also on a timer wheel, by the slow timer tick
+   their 2*MSL ends in, for tcp_slowtmr(). TCP_REG puts them on it;
+   tcp_pcb_remove() takes them off tcp_tw_pcbs with tcp_tw_rmv(), not
+   TCP_RMV, which would walk the list. */
+void  tcp_tw_reg(struct tcp_pcb *pcb);
+void  tcp_tw_rmv(struct tcp_pcb *pcb);
+void  tcp_tw_restart(struct tcp_pcb *pcb);
+
+#define TCP_TW_REG(pcbs, npcb) do { \
+    if ((pcbs) == &tcp_tw_pcbs) {   \
+      tcp_tw_reg(npcb);             \
+    }                               \
+  } while (0)
+#else /* TCP_TW_WHEEL_SIZE */
+#define TCP_TW_REG(pcbs, npcb)
+#endif /* TCP_TW_WHEEL_SIZE */
+
+#if TCP_ACTIVE_WHEEL_SIZE
+/* Active pcbs are on a timer wheel too, by the slow timer tick of their
+   next timer event, and on tcp_fast_pcbs while tcp_fasttmr() has work
+   for them; TCP_REG and TCP_RMV put them on and take them off. Their
+   tick counters (rtime, persist_cnt, polltmr) are brought up to date
+   only when looked at: tcp_input() and tcp_output() call TCP_TMR_SYNC
+   before changing them. Code that starts or restarts a timer calls
+   TCP_TMR_RESCHED, which moves the pcb to an earlier slot if need be;
+   one that sets TF_ACK_DELAY, TF_CLOSEPEND or refused_data calls
+   TCP_TMR_FAST. A deadline that moves later is found when the old slot
+   comes round. */
+void  tcp_tmr_reg(struct tcp_pcb *pcb);
+void  tcp_tmr_rmv(struct tcp_pcb *pcb);
+void  tcp_tmr_sync(struct tcp_pcb *pcb);
+void  tcp_tmr_resched(struct tcp_pcb *pcb);
+void  tcp_tmr_fast(struct tcp_pcb *pcb);
+
+#define TCP_TMR_REG(pcbs, npcb) do {   \
+    if ((pcbs) == &tcp_active_pcbs) {  \
+      tcp_tmr_reg(npcb);               \
+    }                                  \
+  } while (0)
+#define TCP_TMR_RMV(pcbs, npcb) do {   \
+    if ((pcbs) == &tcp_active_pcbs) {  \
+      tcp_tmr_rmv(npcb);               \
+    }                                  \
+  } while (0)
+#define TCP_TMR_SYNC(pcb)    tcp_tmr_sync(pcb)
+#define TCP_TMR_RESCHED(pcb) tcp_tmr_resched(pcb)
+#define TCP_TMR_FAST(pcb)    tcp_tmr_fast(pcb)
+#else /* TCP_ACTIVE_WHEEL_SIZE */
+#define TCP_TMR_REG(pcbs, npcb)
+#define TCP_TMR_RMV(pcbs, npcb)
+#define TCP_TMR_SYNC(pcb)
+#define TCP_TMR_RESCHED(pcb)
+#define TCP_TMR_FAST(pcb)
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
+
 /* Axioms about the above lists:
    1) Every TCP PCB that is not CLOSED is in one of the lists.
    2) A PCB is only in one of the lists.
@@ -367,6 +454,9 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                             (npcb)->next = *(pcbs); \
                             LWIP_ASSERT("TCP_REG: npcb->next != npcb", (npcb)->next != (npcb)); \
                             *(pcbs) = (npcb); \
+                            TCP_HASH_REG(pcbs, npcb); \
+                            TCP_TW_REG(pcbs, npcb); \
+                            TCP_TMR_REG(pcbs, npcb); \
                             LWIP_ASSERT("TCP_REG: tcp_pcbs sane", tcp_pcbs_sane()); \
               tcp_timer_needed(); \
                             } while(0)
@@ -383,6 +473,8 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                                } \
                             } \
                             (npcb)->next = NULL; \
+                            TCP_HASH_RMV(npcb); \
+                            TCP_TMR_RMV(pcbs, npcb); \
                             LWIP_ASSERT("TCP_RMV: tcp_pcbs sane", tcp_pcbs_sane()); \
                             LWIP_DEBUGF(TCP_DEBUG, ("TCP_RMV: removed %p from %p\n", (void *)(npcb), (void *)(*(pcbs)))); \
                             } while(0)
@@ -393,6 +485,9 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
   do {                                             \
     (npcb)->next = *pcbs;                          \
     *(pcbs) = (npcb);                              \
+    TCP_HASH_REG(pcbs, npcb);                      \
+    TCP_TW_REG(pcbs, npcb);                        \
+    TCP_TMR_REG(pcbs, npcb);                       \
     tcp_timer_needed();                            \
   } while (0)
 
@@ -413,6 +508,8 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
       }                                            \
     }                                              \
     (npcb)->next = NULL;                           \
+    TCP_HASH_RMV(npcb);                            \
+    TCP_TMR_RMV(pcbs, npcb);                       \
   } while(0)
 
 #endif /* LWIP_DEBUG */
@@ -453,6 +550,7 @@ struct tcp_seg *tcp_seg_copy(struct tcp_seg *seg);
     }                                              \
     else {                                         \
       tcp_set_flags(pcb, TF_ACK_DELAY);            \
+      TCP_TMR_FAST(pcb);                           \
     }                                              \
   } while (0)
 
@@ -206,11 +206,42 @@ struct tcp_pcb_ext_args {
 typedef u16_t tcpflags_t;
 #define TCP_ALLFLAGS 0xffffU
 
+/**
+ * A congestion control algorithm: how a connection's cwnd and
+ * ssthresh follow acks and losses. The recovery mechanics (fast
+ * retransmit, window inflation during fast recovery, and falling
+ * back to ssthresh when it ends) stay in the core. @see tcp_cc.c
+ */
+struct tcp_cc_ops {
+  const char *name;
+  /** start afresh; the state in pcb->cc_priv is undefined */
+  void (*init)(struct tcp_pcb *pcb);
+  /** new data was acked outside fast recovery, acked bytes of it */
+  void (*on_ack)(struct tcp_pcb *pcb, tcpwnd_size_t acked);
+  /** duplicate acks signalled a loss; fast recovery begins */
+  void (*on_loss)(struct tcp_pcb *pcb);
+  /** the retransmission timer expired */
+  void (*on_rto)(struct tcp_pcb *pcb);
+  /** bytes per second to pace sending at, 0 if unknown */
+  u32_t (*pacing_rate)(struct tcp_pcb *pcb);
+};
+
+/** words of per-connection state for the congestion control */
+#define TCP_CC_PRIV_WORDS 6
+
+#if TCP_PCB_HASH_SIZE
+/* This is a helper define for the links of the pcb hash tables (tcp.c) */
+#define TCP_PCB_HASH_LINKS(type) type *hnext; type **hpprev;
+#else
+#define TCP_PCB_HASH_LINKS(type)
+#endif
+
 /**
  * members common to struct tcp_pcb and struct tcp_listen_pcb
  */
 #define TCP_PCB_COMMON(type) \
   type *next; /* for the linked list */ \
+  TCP_PCB_HASH_LINKS(type) \
   void *callback_arg; \
   TCP_PCB_EXTARGS \
   enum tcp_state state; /* TCP state */ \
@@ -278,6 +309,20 @@ struct tcp_pcb {
   u8_t polltmr, pollinterval;
   u8_t last_timer;
   u32_t tmr;
+#if TCP_TW_WHEEL_SIZE
+  /* TIME-WAIT: tcp_tw_pcbs is doubly linked, and the pcb is on the
+     TIME-WAIT wheel (tcp.c) */
+  struct tcp_pcb **tw_pprev;
+  struct tcp_pcb *tw_wnext;
+#endif /* TCP_TW_WHEEL_SIZE */
+#if TCP_ACTIVE_WHEEL_SIZE
+  /* active: the pcb is on the timer wheel (tcp.c) at slow timer tick
+     wdue, and on tcp_fast_pcbs if fpprev is set. rtime, persist_cnt and
+     polltmr count the ticks up to wtick. */
+  struct tcp_pcb *wnext, **wpprev;
+  struct tcp_pcb *fnext, **fpprev;
+  u32_t wdue, wtick;
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
 
   /* receiver variables */
   u32_t rcv_nxt;   /* next seqno expected */
@@ -334,6 +379,10 @@ struct tcp_pcb {
 
   tcpwnd_size_t bytes_acked;
 
+  /* congestion control algorithm and its state */
+  const struct tcp_cc_ops *cc;
+  u32_t cc_priv[TCP_CC_PRIV_WORDS];
+
   /* These are ordered by sequence number: */
   struct tcp_seg *unsent;   /* Unsent (queued) segments. */
   struct tcp_seg *unacked;  /* Sent but unacknowledged segments. */
@@ -475,6 +524,12 @@ err_t            tcp_write   (struct tcp_pcb *pcb, const void *dataptr, u16_t le
 
 void             tcp_setprio (struct tcp_pcb *pcb, u8_t prio);
 
+extern const struct tcp_cc_ops tcp_cc_newreno;
+extern const struct tcp_cc_ops tcp_cc_cubic;
+const struct tcp_cc_ops *tcp_cc_find(const char *name);
+void             tcp_set_cc  (struct tcp_pcb *pcb, const struct tcp_cc_ops *cc);
+u32_t            tcp_pacing_rate(struct tcp_pcb *pcb);
+
 err_t            tcp_output  (struct tcp_pcb *pcb);
 
 err_t            tcp_tcp_get_tcp_addrinfo(struct tcp_pcb *pcb, int local, ip_addr_t *addr, u16_t *port);
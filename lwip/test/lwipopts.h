@@ -0,0 +1,55 @@
+/* lwIP options of tcptest.c, which runs lwIP on the build host.
+   TCP is set up as in the kernel's NETBULK profile. */
+
+#define NO_SYS 1
+#define SYS_LIGHTWEIGHT_PROT 0
+
+#define LWIP_NETCONN 0
+#define LWIP_SOCKET 0
+
+#define LWIP_ARP 0
+#define LWIP_ETHERNET 0
+#define LWIP_UDP 0
+
+/* the link of tcptest.c delivers packets to our own addresses */
+#define LWIP_NETIF_LOOPBACK 0
+#define LWIP_HAVE_LOOPIF 0
+
+#define LWIP_DEBUG 1
+#define LWIP_STATS 1
+#define MIB2_STATS 1
+
+#define LWIP_TCP_KEEPALIVE 1
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+#define LWIP_TCP_TSO 1
+#define TCP_PCB_HASH_SIZE 256
+
+/* "make lwiptest" also builds tcptest with these at 0 */
+#ifndef LWIP_TIMERS_WHEEL_SIZE
+#define LWIP_TIMERS_WHEEL_SIZE 256
+#endif
+#ifndef TCP_TW_WHEEL_SIZE
+#define TCP_TW_WHEEL_SIZE 256
+#endif
+#ifndef TCP_ACTIVE_WHEEL_SIZE
+#define TCP_ACTIVE_WHEEL_SIZE 256
+#endif
+
+/* the heap comes from malloc(); the pools are lwIP's own, so that
+   a test can run them dry */
+#define MEM_LIBC_MALLOC 1
+#define MEM_ALIGNMENT 8
+
+#define TCP_MSS 1460
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE 1
+#define TCP_WND (64 * 1024)
+#define TCP_SND_BUF (64 * 1024)
+#define TCP_SND_QUEUELEN ((4 * TCP_SND_BUF + TCP_MSS - 1) / TCP_MSS)
+#define LWIP_TCP_SACK_OUT 1
+#define TCP_OOSEQ_MAX_BYTES TCP_WND
+#define MEMP_NUM_TCP_PCB 64
+#define MEMP_NUM_TCP_SEG (4 * TCP_SND_QUEUELEN)
+#define MEMP_NUM_PBUF (2 * TCP_SND_QUEUELEN)
+#define PBUF_POOL_SIZE 64
+#define MEMP_NUM_SYS_TIMEOUT (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 16)
@@ -0,0 +1,683 @@
+/*
+ * tcptest: lwIP's TCP on the build host, between two netifs joined
+ * by a simulated link that can lose packets. It checks that data gets
+ * through intact, and that sys_timeout() and the TCP timers
+ * (retransmission, persist, keepalive, FIN-WAIT-2, TIME-WAIT) fire
+ * when they should, also with segments sent in TSO packets that the
+ * link cuts up. Time is simulated; a run takes a few seconds.
+ *
+ * "make lwiptest" runs it as built with the timer wheels of
+ * lwipopts.h and with lists instead, and compares what the two print:
+ * when each test finished and how many segments it resent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/init.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/ip.h"
+#include "lwip/memp.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+#include "lwip/tcp.h"
+#include "lwip/timeouts.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/priv/tcp_priv.h"
+
+#define STEP_MS 10     /* simulated time per step(), and link latency */
+#define WIRE_MAX 4096  /* packets the link holds */
+
+static u32_t now;      /* simulated time, in ms */
+
+u32_t
+sys_now(void)
+{
+  return now;
+}
+
+static void
+fail(const char *what)
+{
+  printf("FAIL: %s, at %u ms\n", what, (unsigned)now);
+  exit(1);
+}
+
+#define CHECK(c, what) do { if (!(c)) { fail(what); } } while (0)
+
+/*-------------------- the link ---------------------------*/
+/* Packets are copied onto the link and handed to the netif that
+   owns their destination address one step later, unless lost. */
+static struct netif na, nb;
+static struct pbuf *wire[WIRE_MAX];
+static struct netif *wire_to[WIRE_MAX];
+static u32_t wire_head, wire_tail;
+
+static int loss;       /* percent of packets lost */
+static int lose_all;   /* nonzero: the link is down */
+static int lose_tso;   /* nonzero: lose the next TSO packet, whole */
+static u32_t tso_packets, tso_max_len;
+static u32_t rnd = 1;
+
+static u32_t
+rand_next(void)
+{
+  rnd = rnd * 1103515245 + 12345;
+  return rnd >> 16;
+}
+
+static int
+wire_lost(void)
+{
+  return lose_all || (loss && (int)(rand_next() % 100) < loss) ||
+         (wire_tail - wire_head == WIRE_MAX);
+}
+
+/* Put p, a copy of a packet, on the link. */
+static void
+wire_put(struct pbuf *p)
+{
+  const struct ip_hdr *iphdr = (const struct ip_hdr *)p->payload;
+
+  wire_to[wire_tail % WIRE_MAX] =
+    ip4_addr_cmp(&iphdr->dest, netif_ip4_addr(&na)) ? &na : &nb;
+  wire[wire_tail++ % WIRE_MAX] = p;
+}
+
+/* Cut a TCP packet into segments of p->tso_mss bytes of data, as a
+   NIC doing TSO would, and put them on the link. */
+static void
+wire_put_tso(struct pbuf *p)
+{
+  const struct ip_hdr *iphdr = (const struct ip_hdr *)p->payload;
+  u16_t iplen = IPH_HL_BYTES(iphdr);
+  u16_t hlen = (u16_t)(iplen + TCPH_HDRLEN_BYTES((struct tcp_hdr *)((u8_t *)p->payload + iplen)));
+  u16_t len = (u16_t)(p->tot_len - hlen);
+  u16_t off, n;
+  struct pbuf *q;
+  struct ip_hdr *ip;
+  struct tcp_hdr *tcphdr;
+  ip_addr_t src, dest;
+
+  tso_packets++;
+  tso_max_len = LWIP_MAX(tso_max_len, p->tot_len);
+  if (lose_tso) {
+    lose_tso = 0;
+    return;
+  }
+  for (off = 0; off < len; off = (u16_t)(off + n)) {
+    n = LWIP_MIN(p->tso_mss, len - off);
+    if (wire_lost()) {
+      continue;
+    }
+    q = pbuf_alloc(PBUF_RAW, (u16_t)(hlen + n), PBUF_RAM);
+    CHECK(q != NULL, "out of memory for the link");
+    pbuf_copy_partial(p, q->payload, hlen, 0);
+    pbuf_copy_partial(p, (u8_t *)q->payload + hlen, n, (u16_t)(hlen + off));
+    ip = (struct ip_hdr *)q->payload;
+    IPH_LEN_SET(ip, lwip_htons(q->tot_len));
+    IPH_CHKSUM_SET(ip, 0);
+    IPH_CHKSUM_SET(ip, inet_chksum(ip, iplen));
+    tcphdr = (struct tcp_hdr *)((u8_t *)q->payload + iplen);
+    tcphdr->seqno = lwip_htonl(lwip_ntohl(tcphdr->seqno) + off);
+    if (off + n < len) {
+      TCPH_UNSET_FLAG(tcphdr, TCP_PSH | TCP_FIN);
+    }
+    tcphdr->chksum = 0;
+    ip_addr_copy_from_ip4(src, ip->src);
+    ip_addr_copy_from_ip4(dest, ip->dest);
+    pbuf_remove_header(q, iplen);
+    tcphdr->chksum = ip_chksum_pseudo(q, IP_PROTO_TCP, q->tot_len, &src, &dest);
+    pbuf_add_header(q, iplen);
+    wire_put(q);
+  }
+}
+
+static err_t
+wire_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+  struct pbuf *q;
+
+  LWIP_UNUSED_ARG(ipaddr);
+  if (p->tso_mss != 0) {
+    CHECK(netif->tso_max != 0 && p->tot_len <= netif->tso_max, "TSO packet too long");
+    CHECK(netif->tso_max_pbufs == 0 || pbuf_clen(p) <= netif->tso_max_pbufs, "TSO packet in too many pbufs");
+    wire_put_tso(p);
+  } else if (!wire_lost()) {
+    CHECK(p->tot_len <= netif->mtu, "packet longer than the MTU");
+    q = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+    CHECK(q != NULL, "out of memory for the link");
+    wire_put(q);
+  }
+  return ERR_OK;
+}
+
+static err_t
+wire_netif_init(struct netif *netif)
+{
+  netif->output = wire_output;
+  netif->mtu = 1500;
+  return ERR_OK;
+}
+
+/* Check that each active pcb is where the timers look for it. */
+static void
+check_timer_lists(void)
+{
+#if TCP_ACTIVE_WHEEL_SIZE
+  struct tcp_pcb *pcb;
+
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+    CHECK(pcb->wpprev != NULL && *pcb->wpprev == pcb, "active pcb not on the timer wheel");
+    CHECK(!(pcb->flags & (TF_ACK_DELAY | TF_CLOSEPEND)) || pcb->fpprev != NULL,
+          "pcb with a delayed ACK or FIN not on the fast timer list");
+  }
+#endif /* TCP_ACTIVE_WHEEL_SIZE */
+}
+
+/* Let STEP_MS pass: deliver what is on the link, and run the
+   timers that are due. */
+static void
+step(void)
+{
+  u32_t end = wire_tail;
+  struct pbuf *p;
+  struct netif *to;
+
+  now += STEP_MS;
+  while (wire_head != end) {
+    to = wire_to[wire_head % WIRE_MAX];
+    p = wire[wire_head++ % WIRE_MAX];
+    if (to->input(p, to) != ERR_OK) {
+      pbuf_free(p);
+    }
+  }
+  sys_check_timeouts();
+  check_timer_lists();
+}
+
+static void
+run(u32_t ms)
+{
+  u32_t end = now + ms;
+
+  while ((s32_t)(end - now) > 0) {
+    step();
+  }
+}
+
+/*-------------------- connections ---------------------------*/
+/* A client on na sends total bytes of a pattern to a server on nb,
+   which checks them. */
+struct conn {
+  struct tcp_pcb *cli, *srv;
+  int up;           /* client connected */
+  u32_t total;      /* bytes to send */
+  u32_t sent;       /* bytes written */
+  u32_t rcvd;       /* bytes received */
+  u32_t writes;
+  int hold;         /* server does not tcp_recved() what it gets */
+  u32_t held;
+  int refuse;       /* server refuses every third pbuf */
+  u32_t calls;
+  int fin;          /* server got the client's FIN */
+  int cli_gone;     /* lwIP freed the client pcb */
+  u32_t gone_time;
+};
+
+/* byte i of the stream is (i * 7 + 3) & 0xff, so a stream that starts
+   at i can be sent from &pattern[i & 0xff] without copying. */
+static u8_t pattern[256 + 0x10000];
+
+static void
+conn_push(struct conn *c)
+{
+  u8_t buf[1000];
+  u32_t n, i;
+  err_t err;
+
+  while (c->cli != NULL && c->sent < c->total) {
+    /* copy some, reference some: segments of one pbuf or several */
+    n = (c->writes & 1) ? 2920 : sizeof(buf);
+    n = LWIP_MIN(n, LWIP_MIN(c->total - c->sent, tcp_sndbuf(c->cli)));
+    if (n == 0) {
+      break;
+    }
+    if (c->writes & 1) {
+      err = tcp_write(c->cli, &pattern[c->sent & 0xff], (u16_t)n, 0);
+    } else {
+      for (i = 0; i < n; i++) {
+        buf[i] = pattern[(c->sent + i) & 0xff];
+      }
+      err = tcp_write(c->cli, buf, (u16_t)n, TCP_WRITE_FLAG_COPY);
+    }
+    if (err != ERR_OK) {
+      break;
+    }
+    c->sent += n;
+    c->writes++;
+  }
+  if (c->cli != NULL) {
+    tcp_output(c->cli);
+  }
+}
+
+static err_t
+cli_connected(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  struct conn *c = (struct conn *)arg;
+
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(err);
+  c->up = 1;
+  return ERR_OK;
+}
+
+static err_t
+cli_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(len);
+  conn_push((struct conn *)arg);
+  return ERR_OK;
+}
+
+static err_t
+cli_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(err);
+  if (p != NULL) {
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+  }
+  return ERR_OK;
+}
+
+static void
+cli_err(void *arg, err_t err)
+{
+  struct conn *c = (struct conn *)arg;
+
+  LWIP_UNUSED_ARG(err);
+  c->cli = NULL;
+  c->cli_gone = 1;
+  c->gone_time = now;
+}
+
+static err_t
+srv_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  struct conn *c = (struct conn *)arg;
+  struct pbuf *q;
+  u16_t i;
+
+  LWIP_UNUSED_ARG(err);
+  if (p == NULL) {
+    c->fin = 1;
+    return ERR_OK;
+  }
+  if (c->refuse && (++c->calls % 3) == 0) {
+    return ERR_MEM;
+  }
+  for (q = p; q != NULL; q = q->next) {
+    for (i = 0; i < q->len; i++, c->rcvd++) {
+      CHECK(((u8_t *)q->payload)[i] == pattern[c->rcvd & 0xff], "data corrupted");
+    }
+  }
+  if (c->hold) {
+    c->held += p->tot_len;
+  } else {
+    tcp_recved(pcb, p->tot_len);
+  }
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+static void
+srv_err(void *arg, err_t err)
+{
+  LWIP_UNUSED_ARG(err);
+  ((struct conn *)arg)->srv = NULL;
+}
+
+static err_t
+srv_accept(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  struct conn *c = (struct conn *)arg;
+
+  LWIP_UNUSED_ARG(err);
+  c->srv = pcb;
+  tcp_arg(pcb, c);
+  tcp_recv(pcb, srv_recv);
+  tcp_err(pcb, srv_err);
+  return ERR_OK;
+}
+
+/* Connect c's client to a server listening on port. */
+static void
+conn_open(struct conn *c, u16_t port)
+{
+  struct tcp_pcb *l;
+  u32_t end = now + 1000;
+
+  memset(c, 0, sizeof(*c));
+  l = tcp_new();
+  CHECK(l != NULL && tcp_bind(l, netif_ip_addr4(&nb), port) == ERR_OK, "bind");
+  l = tcp_listen(l);
+  CHECK(l != NULL, "listen");
+  tcp_arg(l, c);
+  tcp_accept(l, srv_accept);
+
+  c->cli = tcp_new();
+  CHECK(c->cli != NULL, "tcp_new");
+  /* na and nb are on one subnet: routing alone would pick nb */
+  tcp_bind_netif(c->cli, &na);
+  tcp_arg(c->cli, c);
+  tcp_err(c->cli, cli_err);
+  tcp_sent(c->cli, cli_sent);
+  tcp_recv(c->cli, cli_recv);
+  CHECK(tcp_connect(c->cli, netif_ip_addr4(&nb), port, cli_connected) == ERR_OK, "connect");
+  while ((!c->up || c->srv == NULL) && (s32_t)(end - now) > 0) {
+    step();
+  }
+  CHECK(c->up && c->srv != NULL, "connection not set up");
+  tcp_close(l);
+}
+
+/* Send n more bytes over c, within ms. */
+static void
+conn_send(struct conn *c, u32_t n, u32_t ms)
+{
+  u32_t end = now + ms;
+
+  c->total += n;
+  conn_push(c);
+  while (c->rcvd < c->total && c->cli != NULL && (s32_t)(end - now) > 0) {
+    step();
+  }
+  CHECK(c->rcvd == c->total, "data not delivered in time");
+}
+
+/* Close c, client first. */
+static void
+conn_close(struct conn *c)
+{
+  u32_t end = now + 1000;
+
+  CHECK(c->cli != NULL && tcp_close(c->cli) == ERR_OK, "client close");
+  c->cli = NULL;
+  while (!c->fin && (s32_t)(end - now) > 0) {
+    step();
+  }
+  CHECK(c->fin, "FIN not delivered");
+  CHECK(c->srv != NULL && tcp_close(c->srv) == ERR_OK, "server close");
+  c->srv = NULL;
+  run(1000);
+}
+
+static int
+count(struct tcp_pcb *pcb)
+{
+  int n;
+
+  for (n = 0; pcb != NULL; pcb = pcb->next) {
+    n++;
+  }
+  return n;
+}
+
+static u32_t
+resent(void)
+{
+  return (u32_t)lwip_stats.mib2.tcpretranssegs;
+}
+
+/*-------------------- tests ---------------------------*/
+static u32_t fired[16];
+
+static void
+timeout_fired(void *arg)
+{
+  fired[(size_t)arg] = now;
+}
+
+/* sys_timeout()s fire at the first check at or after they are due,
+   whether due within the span of the wheel or beyond it. */
+static void
+test_timeouts(void)
+{
+  static const u32_t ms[] = { 0, 5, 15, 16, 17, 250, 4095, 4096, 4100, 5000, 70000 };
+  u32_t start = now;
+  size_t i;
+
+  for (i = 0; i < LWIP_ARRAYSIZE(ms); i++) {
+    fired[i] = 0;
+    sys_timeout(ms[i], timeout_fired, (void *)i);
+  }
+  run(ms[LWIP_ARRAYSIZE(ms) - 1] + STEP_MS);
+  for (i = 0; i < LWIP_ARRAYSIZE(ms); i++) {
+    CHECK(fired[i] - start == LWIP_MAX(STEP_MS, (ms[i] + STEP_MS - 1) / STEP_MS * STEP_MS),
+          "timeout late or early");
+  }
+  printf("timeouts: ok\n");
+}
+
+static void
+test_bulk(void)
+{
+  static struct conn c;
+  u32_t start = now, r = resent();
+
+  conn_open(&c, 80);
+  loss = 3;
+  conn_send(&c, 2 * 1000 * 1000, 600 * 1000);
+  loss = 0;
+  printf("bulk, 3%% loss: %u bytes in %u ms, %u segments resent\n",
+         (unsigned)c.rcvd, (unsigned)(now - start), (unsigned)(resent() - r));
+
+  /* the server keeps refusing some of it; the fast timer
+     passes it on again */
+  start = now;
+  c.refuse = 1;
+  conn_send(&c, 1000 * 1000, 600 * 1000);
+  printf("refused data: %u refusals, %u ms\n", (unsigned)(c.calls / 3), (unsigned)(now - start));
+  c.refuse = 0;
+
+  /* the server stops reading: the window closes, and the client
+     probes it until it opens again */
+  start = now;
+  c.hold = 1;
+  c.total += 300 * 1000;
+  conn_push(&c);
+  run(20 * 1000);
+  /* probes after 1.5, 4.5 and 10.5 s back off to the fourth interval */
+  CHECK(c.cli != NULL && c.cli->persist_backoff == 4, "zero window probes not backing off");
+  printf("zero window: %u bytes held\n", (unsigned)c.held);
+  c.hold = 0;
+  while (c.held > 0) {
+    u16_t n = (u16_t)LWIP_MIN(c.held, 0xffff);
+    tcp_recved(c.srv, n);
+    c.held -= n;
+  }
+  conn_send(&c, 0, 60 * 1000);
+  printf("zero window: done after %u ms\n", (unsigned)(now - start));
+  conn_close(&c);
+}
+
+/* A silent peer: keepalive gives up keep_idle + keep_cnt * keep_intvl
+   after the last segment, to within a slow timer tick. */
+static void
+test_keepalive(void)
+{
+  static struct conn c;
+  u32_t start;
+
+  conn_open(&c, 81);
+  start = now;
+  ip_set_option(c.cli, SOF_KEEPALIVE);
+  c.cli->keep_idle = 10000;
+  c.cli->keep_intvl = 1000;
+  c.cli->keep_cnt = 3;
+  lose_all = 1;
+  run(20 * 1000);
+  lose_all = 0;
+  CHECK(c.cli_gone, "keepalive did not give up");
+  CHECK(c.gone_time - start >= 13000 && c.gone_time - start <= 14000, "keepalive gave up at the wrong time");
+  printf("keepalive: gave up after %u ms\n", (unsigned)(c.gone_time - start));
+  tcp_abort(c.srv);
+}
+
+/* The client closes, the server never does: the client gives up
+   TCP_FIN_WAIT_TIMEOUT after the server acked the FIN. */
+static void
+test_fin_wait_2(void)
+{
+  static struct conn c;
+  u32_t start;
+
+  conn_open(&c, 82);
+  start = now;
+  tcp_close(c.cli);
+  run(30 * 1000);
+  CHECK(c.fin, "FIN not delivered");
+  CHECK(c.cli_gone, "FIN-WAIT-2 did not time out");
+  CHECK(c.gone_time - start >= TCP_FIN_WAIT_TIMEOUT && c.gone_time - start <= TCP_FIN_WAIT_TIMEOUT + 1000,
+        "FIN-WAIT-2 timed out at the wrong time");
+  printf("fin-wait-2: timed out after %u ms\n", (unsigned)(c.gone_time - start));
+  tcp_abort(c.srv);
+}
+
+/* A FIN that finds no segment for itself is retried by the fast timer
+   until one is free. */
+static void
+test_closepend(void)
+{
+  static struct conn c;
+  static void *segs[MEMP_NUM_TCP_SEG];
+  u32_t start;
+  int i, n;
+
+  conn_open(&c, 83);
+  conn_send(&c, 1000, 1000);
+  run(1000);
+  for (n = 0; n < MEMP_NUM_TCP_SEG && (segs[n] = memp_malloc(MEMP_TCP_SEG)) != NULL; n++) {
+  }
+  CHECK(tcp_close(c.cli) == ERR_OK, "client close");
+  c.cli = NULL;
+  run(1000);
+  CHECK(!c.fin, "FIN sent without a segment");
+  start = now;
+  for (i = 0; i < n; i++) {
+    memp_free(MEMP_TCP_SEG, segs[i]);
+  }
+  while (!c.fin && now - start < 1000) {
+    step();
+  }
+  CHECK(c.fin, "pending FIN not sent");
+  printf("pending FIN: sent %u ms after segments were freed\n", (unsigned)(now - start));
+  CHECK(tcp_close(c.srv) == ERR_OK, "server close");
+  c.srv = NULL;
+  run(1000);
+}
+
+/* A netif that segments TCP itself gets several segments in one
+   packet. The segments stay as they were queued, so when a whole
+   packet is lost they are resent one by one, and the window opens
+   up again. */
+static void
+test_tso(void)
+{
+  static struct conn c;
+  u32_t start = now, r = resent();
+
+  na.tso_max = 0xffff;
+  na.tso_max_pbufs = 16;
+  conn_open(&c, 84);
+  conn_send(&c, 200 * 1000, 10 * 1000);
+  CHECK(tso_packets > 0 && tso_max_len > TCP_MSS, "no TSO packets sent");
+  lose_tso = 1;
+  conn_send(&c, 200 * 1000, 60 * 1000);
+  CHECK(!lose_tso, "no TSO packet lost");
+  loss = 3;
+  conn_send(&c, 1000 * 1000, 600 * 1000);
+  loss = 0;
+  printf("tso: %u bytes in %u ms, %u packets of up to %u bytes, %u segments resent\n",
+         (unsigned)c.rcvd, (unsigned)(now - start), (unsigned)tso_packets,
+         (unsigned)tso_max_len, (unsigned)(resent() - r));
+  conn_close(&c);
+  na.tso_max = 0;
+}
+
+/* Idle connections stay up; closed, they stay in TIME-WAIT for 2*MSL. */
+static void
+test_idle(void)
+{
+  static struct conn c[20];
+  u32_t first, last;
+  int i, active = count(tcp_active_pcbs);
+
+  run(2 * TCP_MSL + 1000);
+  CHECK(count(tcp_tw_pcbs) == 0, "TIME-WAIT did not end");
+  for (i = 0; i < 20; i++) {
+    conn_open(&c[i], (u16_t)(100 + i));
+  }
+  run(60 * 1000);
+  /* TIME-WAIT counts from the last segment received before the close */
+  for (i = 0; i < 20; i++) {
+    CHECK(c[i].cli != NULL && c[i].cli->state == ESTABLISHED, "idle connection dropped");
+    conn_send(&c[i], 1000, 1000);
+    if (i == 0) {
+      first = now;
+    }
+    last = now;
+    run(1000);     /* the delayed ACK */
+    conn_close(&c[i]);
+  }
+  CHECK(count(tcp_active_pcbs) == active, "closed pcbs still active");
+  CHECK(count(tcp_tw_pcbs) == 20, "closed pcbs not in TIME-WAIT");
+  while (count(tcp_tw_pcbs) == 20) {
+    step();
+  }
+  CHECK(now - first >= 2 * TCP_MSL && now - first <= 2 * TCP_MSL + 1000, "TIME-WAIT ended at the wrong time");
+  while (count(tcp_tw_pcbs) > 0) {
+    step();
+  }
+  CHECK(now - last >= 2 * TCP_MSL && now - last <= 2 * TCP_MSL + 1000, "TIME-WAIT ended at the wrong time");
+  printf("idle: 20 connections up for 60 s, closed\n");
+}
+
+int
+main(void)
+{
+  ip4_addr_t a, b, mask;
+  size_t i;
+
+  for (i = 0; i < sizeof(pattern); i++) {
+    pattern[i] = (u8_t)(i * 7 + 3);
+  }
+  srand(1);
+  lwip_init();
+  IP4_ADDR(&a, 10, 0, 0, 1);
+  IP4_ADDR(&b, 10, 0, 0, 2);
+  IP4_ADDR(&mask, 255, 255, 255, 0);
+  netif_add(&na, &a, &mask, IP4_ADDR_ANY4, NULL, wire_netif_init, ip_input);
+  netif_add(&nb, &b, &mask, IP4_ADDR_ANY4, NULL, wire_netif_init, ip_input);
+  netif_set_up(&na);
+  netif_set_up(&nb);
+  netif_set_link_up(&na);
+  netif_set_link_up(&nb);
+
+  test_timeouts();
+  test_bulk();
+  test_keepalive();
+  test_fin_wait_2();
+  test_closepend();
+  test_tso();
+  test_idle();
+  printf("all tests passed\n");
+  return 0;
+}
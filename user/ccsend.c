@@ -0,0 +1,82 @@
+// Send a stream of bytes over TCP with a given congestion control,
+// and report how long it took. To compare algorithms on a long fat
+// link, run a sink on the host behind an artificial delay, e.g.
+//
+//   host$ sudo tc qdisc add dev lo root netem delay 50ms
+//   host$ nc -l 1234 > /dev/null
+//   xv6$ ccsend 10.0.2.2 1234 4096 cubic
+//
+// (10.0.2.2 is the host as seen from QEMU's user-mode network.)
+
+#include "kernel/types.h"
+#include "kernel/socket.h"
+#include "user/user.h"
+
+// parse a dotted quad into an ip4_addr, net order.
+int
+parseip(char *s, ip4_addr *ip)
+{
+  uchar *b = (uchar *)ip;
+  int i, n;
+
+  for (i = 0; i < 4; i++) {
+    if (*s < '0' || *s > '9')
+      return -1;
+    for (n = 0; *s >= '0' && *s <= '9'; s++)
+      n = n * 10 + *s - '0';
+    if (n > 255 || *s != (i < 3 ? '.' : '\0'))
+      return -1;
+    b[i] = n;
+    s++;
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static char buf[4096];
+  ip4_addr ip;
+  int fd, kb, n, t0, t1;
+  long sent;
+
+  if (argc < 4 || parseip(argv[1], &ip) < 0) {
+    fprintf(2, "usage: ccsend ip port kbytes [newreno|cubic]\n");
+    exit(1);
+  }
+  kb = atoi(argv[3]);
+
+  fd = socket(SOCK_STREAM);
+  if (fd < 0) {
+    fprintf(2, "ccsend: socket failed\n");
+    exit(1);
+  }
+  if (argc > 4 && socket_setcc(fd, argv[4]) < 0) {
+    fprintf(2, "ccsend: no congestion control %s\n", argv[4]);
+    exit(1);
+  }
+  if (socket_connect(fd, ip, atoi(argv[2])) != 0) {
+    fprintf(2, "ccsend: connect failed\n");
+    exit(1);
+  }
+
+  memset(buf, 'x', sizeof(buf));
+  t0 = uptime();
+  for (sent = 0; sent < (long)kb * 1024; sent += n) {
+    n = sizeof(buf);
+    if (n > (long)kb * 1024 - sent)
+      n = (long)kb * 1024 - sent;
+    if ((n = write(fd, buf, n)) <= 0) {
+      fprintf(2, "ccsend: write failed after %d bytes\n", (int)sent);
+      break;
+    }
+  }
+  t1 = uptime();
+  close(fd);
+
+  printf("ccsend: %d KB in %d ticks", (int)(sent / 1024), t1 - t0);
+  if (t1 > t0)
+    printf(", %d KB/tick", (int)(sent / 1024 / (t1 - t0)));
+  printf("\n");
+  exit(0);
+}
@@ -1,4 +1,5 @@
 #include "kernel/types.h"
+#include "kernel/socket.h"
 #include "user/user.h"
 
 #define DAYTIME_SERVER_HOST "utcnist.colorado.edu"
@@ -22,7 +23,7 @@ int daytime_test() {
   ip4_addr ip;
   uint16 port = DAYTIME_SERVER_PORT;
 
-  socket_fd = socket();
+  socket_fd = socket(SOCK_STREAM);
 
   res = dns_api_gethostbyname(DAYTIME_SERVER_HOST, &ip);
   if (res != 0) {
@@ -59,7 +60,7 @@ int client_send_recv_test() {
   ip4_addr ip;
   uint16 port = CLIENT_TEST_SERVER_PORT;
 
-  socket_fd = socket();
+  socket_fd = socket(SOCK_STREAM);
 
   res = dns_api_gethostbyname(CLIENT_TEST_SERVER_HOST, &ip);
   if (res != 0) {
@@ -87,7 +88,7 @@ int client_send_recv_test() {
 
 // Test server's basic functionality
 int server_send_recv_test() {
-  int listen_fd = socket();
+  int listen_fd = socket(SOCK_STREAM);
   int conn_fd;
   ip4_addr ip = 0;
   uint16 port = SERVER_TEST_PORT;
@@ -96,7 +97,7 @@ int server_send_recv_test() {
 
   socket_bind(listen_fd, ip, port);
   printf("socket_bind.\n");
-  socket_listen(listen_fd);
+  socket_listen(listen_fd, 8);
   printf("socket_listen.\n");
   while (1) {
     conn_fd = socket_accept(listen_fd);
@@ -1,5 +1,9 @@
 struct stat;
 struct rtcdate;
+struct pollfd;
+struct epoll_event;
+struct iovec;
+struct mmsghdr;
 
 typedef uint32 ip4_addr;
 
@@ -27,6 +31,14 @@ int sleep(int);
 int uptime(void);
 int ntas();
 int nfree();
+int fcntl(int fd, int cmd, int arg);
+int poll(struct pollfd *fds, int nfds, int timeout);
+int epoll_create(void);
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+int sendfile(int out_fd, int in_fd, int offset, int count);
+int readv(int fd, const struct iovec *iov, int iovcnt);
+int writev(int fd, const struct iovec *iov, int iovcnt);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -46,11 +58,14 @@ int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
 
 // socket related system call
-int socket();
+int socket(int type);
 int socket_connect(int fd, ip4_addr ip, uint16 port);
 int socket_bind(int fd, ip4_addr ip, uint16 port);
-int socket_listen(int fd);
+int socket_listen(int fd, int backlog);
 int socket_accept(int fd);
+int sendmmsg(int fd, struct mmsghdr *msgs, int n);
+int recvmmsg(int fd, struct mmsghdr *msgs, int n);
+int socket_setcc(int fd, const char *name);
 
 // DNS related system call
 int dns_api_gethostbyname(const char *hostname, ip4_addr *ip);
@@ -4,6 +4,9 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/poll.h"
+#include "kernel/uio.h"
+#include "kernel/socket.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
@@ -524,6 +527,613 @@ pipe1(char *s)
   }
 }
 
+// A write larger than lwIP's send buffer, to a slow reader on
+// 127.0.0.1: it blocks until all of it is queued, and arrives
+// whole and in order.
+void
+tcpbulk(char *s)
+{
+  enum { N=4096, PORT=7780 };
+  uint32 lo = 0x0100007f;  // 127.0.0.1, net order
+  int l, fd, pid, n, m, i, xstatus;
+
+  l = socket(SOCK_STREAM);
+  if(l < 0){
+    printf("%s: socket failed\n", s);
+    exit(1);
+  }
+  if(socket_bind(l, lo, PORT) != 0 || socket_listen(l, 1) != 0){
+    printf("%s: listen failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    fd = socket(SOCK_STREAM);
+    if(fd < 0 || socket_connect(fd, lo, PORT) != 0){
+      printf("%s: connect failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < N; i++)
+      buf[i] = i*7 + 3;
+    if(write(fd, buf, N) != N){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    exit(0);
+  }
+
+  fd = socket_accept(l);
+  if(fd < 0){
+    printf("%s: accept failed\n", s);
+    exit(1);
+  }
+  // the socket reads -1 once the writer has closed.
+  for(n = 0; n < N && (m = read(fd, buf + n, 512)) > 0; n += m)
+    sleep(1);
+  if(n != N){
+    printf("%s: read %d bytes\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(buf[i] != (char)(i*7 + 3)){
+      printf("%s: wrong byte at %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(read(fd, buf, 1) != -1){
+    printf("%s: read after close did not fail\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(l);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+}
+
+// A listening socket holds up to its backlog of connections for
+// socket_accept(); one beyond it is set up only once an accept
+// makes room.
+void
+tcpbacklog(char *s)
+{
+  enum { PORT=7781 };
+  uint32 lo = 0x0100007f;  // 127.0.0.1, net order
+  int l, c, a, pid, fds[2], t, up, xstatus;
+
+  l = socket(SOCK_STREAM);
+  if(l < 0){
+    printf("%s: socket failed\n", s);
+    exit(1);
+  }
+  if(socket_bind(l, lo, PORT) != 0 || socket_listen(l, 1) != 0){
+    printf("%s: listen failed\n", s);
+    exit(1);
+  }
+  c = socket(SOCK_STREAM);
+  if(c < 0 || socket_connect(c, lo, PORT) != 0){
+    printf("%s: connect failed\n", s);
+    exit(1);
+  }
+  if(write(c, "1", 1) != 1){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+
+  // the second connection has to wait for the first accept.
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(c);
+    c = socket(SOCK_STREAM);
+    if(c < 0 || socket_connect(c, lo, PORT) != 0){
+      printf("%s: second connect failed\n", s);
+      exit(1);
+    }
+    up = uptime();
+    if(write(c, "2", 1) != 1 || write(fds[1], &up, sizeof(up)) != sizeof(up)){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+    close(c);
+    exit(0);
+  }
+  close(fds[1]);
+
+  sleep(10);
+  t = uptime();
+  a = socket_accept(l);
+  if(a < 0 || read(a, buf, 10) != 1 || buf[0] != '1'){
+    printf("%s: first accept failed\n", s);
+    exit(1);
+  }
+  close(c);
+  if(read(a, buf, 10) != -1){
+    printf("%s: no end of first connection\n", s);
+    exit(1);
+  }
+  close(a);
+
+  if(read(fds[0], &up, sizeof(up)) != sizeof(up) || up < t){
+    printf("%s: second connection set up before the first accept\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  a = socket_accept(l);
+  if(a < 0 || read(a, buf, 10) != 1 || buf[0] != '2'){
+    printf("%s: second accept failed\n", s);
+    exit(1);
+  }
+  if(read(a, buf, 10) != -1){
+    printf("%s: no end of second connection\n", s);
+    exit(1);
+  }
+  close(a);
+  close(l);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+}
+
+// poll() on the two ends of a pipe, before and after a write,
+// and after the write end is closed.
+void
+pollpipe(char *s)
+{
+  int fds[2];
+  struct pollfd pfd[3];
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pfd[0].fd = fds[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = fds[1];
+  pfd[1].events = POLLOUT;
+  pfd[2].fd = 100;  // not open
+  pfd[2].events = POLLIN;
+  if(poll(pfd, 3, 0) != 2){
+    printf("%s: poll of empty pipe failed\n", s);
+    exit(1);
+  }
+  if(pfd[0].revents != 0 || pfd[1].revents != POLLOUT ||
+     pfd[2].revents != POLLNVAL){
+    printf("%s: empty pipe revents %x %x %x\n", s,
+           pfd[0].revents, pfd[1].revents, pfd[2].revents);
+    exit(1);
+  }
+
+  if(write(fds[1], "x", 1) != 1){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != POLLIN){
+    printf("%s: written pipe not readable\n", s);
+    exit(1);
+  }
+
+  close(fds[1]);
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != (POLLIN|POLLHUP)){
+    printf("%s: closed pipe revents %x\n", s, pfd[0].revents);
+    exit(1);
+  }
+  if(read(fds[0], buf, 1) != 1 || read(fds[0], buf, 1) != 0){
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != POLLHUP){
+    printf("%s: drained pipe revents %x\n", s, pfd[0].revents);
+    exit(1);
+  }
+  close(fds[0]);
+}
+
+
+// epoll_ctl() rejects what it cannot watch.
+void
+epollctl(char *s)
+{
+  enum { PORT=7782 };
+  uint32 lo = 0x0100007f;  // 127.0.0.1, net order
+  struct epoll_event ev, out;
+  struct pollfd pfd;
+  int ep, fds[2], l, sock, a;
+
+  ep = epoll_create();
+  if(ep < 0){
+    printf("%s: epoll_create failed\n", s);
+    exit(1);
+  }
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  l = socket(SOCK_STREAM);
+  sock = socket(SOCK_STREAM);
+  if(l < 0 || sock < 0){
+    printf("%s: socket failed\n", s);
+    exit(1);
+  }
+  if(socket_bind(l, lo, PORT) != 0 || socket_listen(l, 1) != 0 ||
+     socket_connect(sock, lo, PORT) != 0){
+    printf("%s: connect failed\n", s);
+    exit(1);
+  }
+  a = socket_accept(l);
+  if(a < 0){
+    printf("%s: accept failed\n", s);
+    exit(1);
+  }
+  ev.events = POLLIN;
+  ev.data = 7;
+
+  if(epoll_ctl(ep, EPOLL_CTL_ADD, fds[0], &ev) != -1 ||
+     epoll_ctl(ep, EPOLL_CTL_ADD, ep, &ev) != -1 ||
+     epoll_ctl(ep, EPOLL_CTL_ADD, 100, &ev) != -1 ||
+     epoll_ctl(fds[0], EPOLL_CTL_ADD, sock, &ev) != -1){
+    printf("%s: epoll_ctl added a bad fd\n", s);
+    exit(1);
+  }
+  if(epoll_ctl(ep, EPOLL_CTL_MOD, sock, &ev) != -1 ||
+     epoll_ctl(ep, EPOLL_CTL_DEL, sock, 0) != -1){
+    printf("%s: epoll_ctl changed an fd not added\n", s);
+    exit(1);
+  }
+  if(epoll_ctl(ep, 0, sock, &ev) != -1){
+    printf("%s: epoll_ctl took a bad op\n", s);
+    exit(1);
+  }
+
+  pfd.fd = ep;
+  pfd.events = POLLIN;
+  if(poll(&pfd, 1, 0) != 0){
+    printf("%s: empty epoll fd readable\n", s);
+    exit(1);
+  }
+  if(epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev) != 0){
+    printf("%s: epoll_ctl add failed\n", s);
+    exit(1);
+  }
+  if(epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev) != -1){
+    printf("%s: epoll_ctl added an fd twice\n", s);
+    exit(1);
+  }
+  ev.events = POLLOUT;
+  if(epoll_ctl(ep, EPOLL_CTL_MOD, sock, &ev) != 0){
+    printf("%s: epoll_ctl mod failed\n", s);
+    exit(1);
+  }
+  // a connected socket with room to send is writable.
+  if(poll(&pfd, 1, 0) != 1 || pfd.revents != POLLIN){
+    printf("%s: epoll fd not readable\n", s);
+    exit(1);
+  }
+  if(epoll_wait(ep, &out, 1, 0) != 1 || out.events != POLLOUT || out.data != 7){
+    printf("%s: epoll_wait failed\n", s);
+    exit(1);
+  }
+  if(epoll_ctl(ep, EPOLL_CTL_DEL, sock, 0) != 0 ||
+     epoll_ctl(ep, EPOLL_CTL_DEL, sock, 0) != -1){
+    printf("%s: epoll_ctl del failed\n", s);
+    exit(1);
+  }
+  if(epoll_wait(ep, &out, 1, 0) != 0){
+    printf("%s: epoll_wait reported a deleted fd\n", s);
+    exit(1);
+  }
+  close(sock);
+  if(read(a, buf, 1) != -1){
+    printf("%s: no end of connection\n", s);
+    exit(1);
+  }
+  close(a);
+  close(l);
+  close(fds[0]);
+  close(fds[1]);
+  close(ep);
+}
+
+
+// sendfile() from a file to a reader on 127.0.0.1: from an offset,
+// then from the file's own offset up to its end.
+void
+sendfiletest(char *s)
+{
+  enum { N=3000, PORT=7783 };
+  uint32 lo = 0x0100007f;  // 127.0.0.1, net order
+  int l, c, a, fd, fds[2], pid, n, m, i, xstatus;
+
+  for(i = 0; i < N; i++)
+    buf[i] = i*7 + 3;
+  fd = open("sendfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, N) != N){
+    printf("%s: create sendfile failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("sendfile", O_RDONLY);
+
+  l = socket(SOCK_STREAM);
+  c = socket(SOCK_STREAM);
+  if(l < 0 || c < 0){
+    printf("%s: socket failed\n", s);
+    exit(1);
+  }
+  if(socket_bind(l, lo, PORT) != 0 || socket_listen(l, 1) != 0 ||
+     socket_connect(c, lo, PORT) != 0){
+    printf("%s: connect failed\n", s);
+    exit(1);
+  }
+  a = socket_accept(l);
+  if(a < 0){
+    printf("%s: accept failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // the socket reads -1 once the sender has closed.
+    close(c);
+    for(n = 0; n < BUFSZ-N && (m = read(a, buf + N + n, BUFSZ-N-n)) > 0; n += m)
+      ;
+    if(n != 2000 + N || memcmp(buf + N, buf + 500, 2000) != 0 ||
+       memcmp(buf + N + 2000, buf, N) != 0){
+      printf("%s: received %d bytes\n", s, n);
+      exit(1);
+    }
+    exit(0);
+  }
+  close(a);
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if(sendfile(fds[1], fd, 0, 10) != -1 || sendfile(c, fds[0], 0, 10) != -1){
+    printf("%s: sendfile to or from a pipe succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  if(sendfile(c, fd, 500, 2000) != 2000){
+    printf("%s: sendfile from offset failed\n", s);
+    exit(1);
+  }
+  if(sendfile(c, fd, -1, 2*N) != N || sendfile(c, fd, -1, 10) != 0){
+    printf("%s: sendfile to end of file failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("sendfile");
+  close(c);
+  close(l);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+}
+
+// readv() and writev() across several buffers, on a file and a pipe.
+void
+rwvec(char *s)
+{
+  struct iovec iov[IOV_MAX+1];
+  char a[3], b[5], c[7];
+  int fd, fds[2], i, n;
+
+  iov[0].iov_base = "abc";
+  iov[0].iov_len = 3;
+  iov[1].iov_base = "";
+  iov[1].iov_len = 0;
+  iov[2].iov_base = "defgh";
+  iov[2].iov_len = 5;
+  iov[3].iov_base = "ijklmno";
+  iov[3].iov_len = 7;
+
+  fd = open("rwvec", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create rwvec failed\n", s);
+    exit(1);
+  }
+  if(writev(fd, iov, 4) != 15){
+    printf("%s: writev to file failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("rwvec", O_RDONLY);
+  iov[0].iov_base = a;
+  iov[1].iov_base = b;
+  iov[1].iov_len = 5;
+  iov[2].iov_base = c;
+  iov[2].iov_len = 7;
+  if(readv(fd, iov, 3) != 15 || memcmp(a, "abc", 3) != 0 ||
+     memcmp(b, "defgh", 5) != 0 || memcmp(c, "ijklmno", 7) != 0){
+    printf("%s: readv from file failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("rwvec");
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < IOV_MAX+1; i++){
+    iov[i].iov_base = &buf[i];
+    iov[i].iov_len = 1;
+    buf[i] = 'A' + i;
+  }
+  if(writev(fds[1], iov, IOV_MAX+1) != -1){
+    printf("%s: writev of IOV_MAX+1 buffers succeeded\n", s);
+    exit(1);
+  }
+  if(writev(fds[1], iov, IOV_MAX) != IOV_MAX){
+    printf("%s: writev to pipe failed\n", s);
+    exit(1);
+  }
+  // a pipe read returns what is there, so one buffer takes it all.
+  iov[0].iov_base = buf + IOV_MAX+1;
+  iov[0].iov_len = IOV_MAX;
+  iov[1].iov_base = buf + 2*IOV_MAX+1;
+  iov[1].iov_len = 1;
+  n = readv(fds[0], iov, 2);
+  if(n != IOV_MAX || memcmp(buf + IOV_MAX+1, buf, IOV_MAX) != 0){
+    printf("%s: readv from pipe got %d\n", s, n);
+    exit(1);
+  }
+  if(readv(fds[0], iov, IOV_MAX+1) != -1){
+    printf("%s: readv of IOV_MAX+1 buffers succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+
+// UDP datagrams to 127.0.0.1 with sendmmsg() and recvmmsg().
+void
+udploop(char *s)
+{
+  enum { N=4, PORT=7777 };
+  struct mmsghdr msg[N+1];
+  uint32 lo = 0x0100007f;  // 127.0.0.1, net order
+  int rx, tx, i, n;
+
+  rx = socket(SOCK_DGRAM);
+  tx = socket(SOCK_DGRAM);
+  if(rx < 0 || tx < 0){
+    printf("%s: socket failed\n", s);
+    exit(1);
+  }
+  if(socket_bind(rx, 0, PORT) != 0){
+    printf("%s: bind failed\n", s);
+    exit(1);
+  }
+  if(fcntl(rx, F_SETFL, fcntl(rx, F_GETFL, 0) | O_NONBLOCK) < 0){
+    printf("%s: fcntl failed\n", s);
+    exit(1);
+  }
+  msg[0].msg_buf = buf;
+  msg[0].msg_len = 10;
+  if(recvmmsg(rx, msg, 1) != -1){
+    printf("%s: recvmmsg of empty socket did not fail\n", s);
+    exit(1);
+  }
+
+  for(i = 0; i < N*100; i++)
+    buf[i] = i;
+  for(i = 0; i < N; i++){
+    msg[i].msg_buf = buf + i*100;
+    msg[i].msg_len = 10*(i+1);
+    msg[i].msg_addr = lo;
+    msg[i].msg_port = PORT;
+  }
+  if(sendmmsg(tx, msg, N) != N){
+    printf("%s: sendmmsg failed\n", s);
+    exit(1);
+  }
+
+  for(i = 0; i < N+1; i++){
+    msg[i].msg_buf = buf + N*100 + i*100;
+    msg[i].msg_len = 100;
+  }
+  n = recvmmsg(rx, msg, N+1);
+  if(n != N){
+    printf("%s: recvmmsg got %d datagrams\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(msg[i].msg_len != 10*(i+1) || msg[i].msg_addr != lo ||
+       memcmp(msg[i].msg_buf, buf + i*100, msg[i].msg_len) != 0){
+      printf("%s: datagram %d wrong\n", s, i);
+      exit(1);
+    }
+  }
+  close(tx);
+  close(rx);
+}
+
+
+// Two connections to one port of 127.0.0.1, written in turns: each
+// accepted socket gets the data of its own connection.
+void
+tcpdemux(char *s)
+{
+  enum { N=2, ROUNDS=10, PORT=7784 };
+  uint32 lo = 0x0100007f;  // 127.0.0.1, net order
+  int l, c[N], a[N], i, j, n, m;
+  char b[ROUNDS];
+
+  l = socket(SOCK_STREAM);
+  if(l < 0 || socket_bind(l, lo, PORT) != 0 || socket_listen(l, N) != 0){
+    printf("%s: listen failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    c[i] = socket(SOCK_STREAM);
+    if(c[i] < 0 || socket_connect(c[i], lo, PORT) != 0){
+      printf("%s: connect failed\n", s);
+      exit(1);
+    }
+  }
+  // accepted in the order they connected.
+  for(i = 0; i < N; i++){
+    a[i] = socket_accept(l);
+    if(a[i] < 0){
+      printf("%s: accept failed\n", s);
+      exit(1);
+    }
+  }
+  for(j = 0; j < ROUNDS; j++){
+    for(i = 0; i < N; i++){
+      b[0] = 'a' + i*ROUNDS + j;
+      if(write(c[i], b, 1) != 1){
+        printf("%s: write failed\n", s);
+        exit(1);
+      }
+    }
+  }
+  for(i = 0; i < N; i++)
+    close(c[i]);
+
+  for(i = 0; i < N; i++){
+    for(n = 0; n < ROUNDS && (m = read(a[i], b + n, ROUNDS - n)) > 0; n += m)
+      ;
+    if(n != ROUNDS){
+      printf("%s: connection %d got %d bytes\n", s, i, n);
+      exit(1);
+    }
+    for(j = 0; j < ROUNDS; j++){
+      if(b[j] != 'a' + i*ROUNDS + j){
+        printf("%s: connection %d got another's data\n", s, i);
+        exit(1);
+      }
+    }
+    if(read(a[i], b, 1) != -1){
+      printf("%s: no end of connection %d\n", s, i);
+      exit(1);
+    }
+    close(a[i]);
+  }
+  close(l);
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(char *s)
@@ -2300,6 +2910,14 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     // {mem, "mem"},
     {pipe1, "pipe1"},
+    {tcpbulk, "tcpbulk"},
+    {tcpbacklog, "tcpbacklog"},
+    {pollpipe, "pollpipe"},
+    {epollctl, "epollctl"},
+    {sendfiletest, "sendfile"},
+    {rwvec, "rwvec"},
+    {udploop, "udploop"},
+    {tcpdemux, "tcpdemux"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
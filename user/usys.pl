@@ -44,3 +44,14 @@ entry("socket_bind");
 entry("socket_listen");
 entry("socket_accept");
 entry("dns_api_gethostbyname");
+entry("fcntl");
+entry("poll");
+entry("epoll_create");
+entry("epoll_ctl");
+entry("epoll_wait");
+entry("sendfile");
+entry("readv");
+entry("writev");
+entry("sendmmsg");
+entry("recvmmsg");
+entry("socket_setcc");